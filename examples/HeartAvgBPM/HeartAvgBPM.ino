@@ -21,8 +21,11 @@ the Free Software Foundation.
 
 
 
-// Create instance for sensor on analog input pin.
-Heart heart(A1);
+// Create instance for sensor.
+Heart heart;
+
+// Beats detected by the sensor are queued here and handled in loop().
+EventQueue<8> beats;
 
 // variables for lighting onboard LED on heartbeat without delays
 int LED = 13;       // onboard LED
@@ -32,8 +35,6 @@ const long ledInterval = 50;        // interval at which to blink LED (milliseco
 // if you do not receive a heartbeat value in over 5 seconds, flush the BPM array and start fresh
 const long flushInterval = 2000;    //interval at which to refresh values stored in array
 
-boolean doOnce = true;   // makes sure that if a heartbeat is found that information is gathered only once during cycle
-
 // variables for averaging BPM over several heartbeats
 int bpmCounter = 0;      // counter for counting bpmArray position     
 int bpmArray[100];   // the array that holds bpm values. Define as a large number you don't need to use them all.
@@ -46,29 +47,29 @@ void setup() {
   pinMode(LED, OUTPUT);
   litMillis = ledInterval;  // make sure the LED doesn't light up automatically
   
-  // Initialize sensor.
-  heart.reset();
+  // Initialize sensor and send its beats to the queue.
+  heart.initialize();
+  heart.setEventHandler(EventQueue<8>::handler, &beats);
 }
 
 void loop() {
   // Update sensor.
-  heart.update();
+  heart.update(analogRead(A1));
   // update time
   unsigned long currentMillis = millis();   
   
-  if (heart.beatDetected()){  
-    if (doOnce == true){
+  // Each beat is received exactly once, with the interval since the previous beat (ms).
+  BioEvent beat;
+  while (bpmCounter < arraySize && beats.pop(beat)) {
     litMillis = currentMillis;
     digitalWrite(LED, HIGH);                // turn on an LED for visual feedback that heartbeat occurred
     
-    bpmArray[bpmCounter] = heart.getBPM();  // grab a BPM snapshot every time a heartbeat occurs
-    bpmCounter++;                           // increment the BPMcounter value
-    doOnce = false;
+    int beatBPM = 60000 / beat.value;       // BPM of this heartbeat
+    if (beatBPM > 30 && beatBPM < 200) {    // ignore intervals out of bounds (eg. first beat)
+      bpmArray[bpmCounter] = beatBPM;
+      bpmCounter++;                         // increment the BPMcounter value
     }
   }
-  else {
-    doOnce = true;
-  }
 
   if (bpmCounter == (arraySize)) {                    // if you have grabbed enough heartbeats to average                                      
     
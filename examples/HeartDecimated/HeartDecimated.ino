@@ -0,0 +1,57 @@
+// This example demonstrates oversampling the heart sensor at 1 kHz and
+// decimating to the 200 Hz rate of Heart with an anti-aliasing filter, so
+// that all ADC readings contribute to the signal instead of being dropped.
+// for more info see README at https://github.com/eringee/BioData/
+/******************************************************
+copyright Erin Gee 2017
+Authors Erin Gee // Martin Peach // Thomas Ouellet-Fredericks
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 3 as published by
+the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    For more details: <http://www.gnu.org/licenses/>.
+******************************************************/
+#include <Heart.h>
+#include <Decimator.h>
+
+const int heartPin = A1;
+
+const unsigned long adcRate = 1000;                  // ADC sampling rate (Hz)
+const unsigned long heartRate = 200;                 // Heart sample rate (Hz)
+const unsigned long microsBetweenReads = 1000000UL / adcRate;
+
+// Create instance for sensor at 200 Hz.
+Heart heart(heartRate);
+
+// 1 kHz -> 200 Hz: decimate by 5 through a 31-tap low-pass.
+Decimator<adcRate / heartRate, 31> decimator;
+
+unsigned long prevReadMicros = 0;
+
+//variable for attenuating data flow to serial port prevents crashes
+const long printInterval = 20;       // millis
+
+void setup() {
+  Serial.begin(9600);  // works best in testing with 9600 or lower
+}
+
+void loop() {
+  unsigned long now = micros();
+  if (now - prevReadMicros >= microsBetweenReads) {
+    prevReadMicros += microsBetweenReads;
+
+    // A new 200 Hz value is ready every 5 ADC readings: feed it directly to
+    // the sensor (bypassing the rate check of heart.update()).
+    if (decimator.push(analogRead(heartPin)))
+      heart.sample(decimator.get());
+  }
+
+  if (millis() % printInterval == 0) {
+    Serial.print(heart.getNormalized());
+    Serial.print("\t");
+    Serial.println(heart.getBPM());
+  }
+}
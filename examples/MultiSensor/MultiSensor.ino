@@ -0,0 +1,72 @@
+// This example samples heart, skin conductance and respiration sensors from a
+// single scheduler instead of letting each sensor check its own clock.
+// The scheduler spreads the sensors over different ticks so that their
+// processing does not pile up on the same loop.
+// for more info see README at https://github.com/eringee/BioData/
+/******************************************************
+copyright Erin Gee 2017
+
+Authors Erin Gee // Martin Peach // Thomas Ouellet-Fredericks
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 3 as published by
+the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For more details: <http://www.gnu.org/licenses/>.
+
+******************************************************/
+#include <Heart.h>
+#include <SkinConductance.h>
+#include <Respiration.h>
+#include <Scheduler.h>
+
+Heart heart(200);
+SkinConductance sc(50);
+Respiration resp(50);
+
+// 1 kHz time base with room for three sensors.
+Scheduler<3> scheduler(1000);
+
+// Each task reads its sensor and processes the sample at the time of its tick.
+void sampleHeart(unsigned long t, void*) { heart.sample(analogRead(A1), t); }
+void sampleSkinConductance(unsigned long t, void*) { sc.sample(analogRead(A6), t); }
+void sampleRespiration(unsigned long t, void*) { resp.sample(analogRead(A0), t); }
+
+//variable for attenuating data flow to serial port prevents crashes
+const long printInterval = 50;       // millis
+unsigned long printMillis = 0;
+
+void setup() {
+  Plaquette.begin(); // initialize Plaquette (used by Respiration)
+  Serial.begin(9600);
+
+  // Tasks run in the order they are added.
+  scheduler.add(sampleHeart, NULL, 200);
+  scheduler.add(sampleSkinConductance, NULL, 50);
+  scheduler.add(sampleRespiration, NULL, 50);
+  scheduler.reset(micros());
+}
+
+void loop() {
+  Plaquette.step();
+
+  // One clock read for all sensors.
+  scheduler.update(micros());
+
+  unsigned long currentMillis = millis();
+  if (currentMillis - printMillis >= printInterval) {
+    printMillis = currentMillis;
+    Serial.print(heart.getBPM());
+    Serial.print("\t");
+    Serial.print(sc.getSCR());
+    Serial.print("\t");
+    Serial.print(resp.getScaled());
+    Serial.print("\t");
+    Serial.println(scheduler.getMissedTicks());
+  }
+}
@@ -0,0 +1,546 @@
+/*
+ * biodata_module.cpp
+ *
+ * Python bindings of Heart and SkinConductance for offline analysis, so that
+ * recorded sessions are processed by exactly the same code as on the device.
+ *
+ *   import biodata, numpy as np
+ *   heart = biodata.Heart(200)
+ *   features = heart.process(np.asarray(signal, dtype=np.float32))
+ *   bpm = np.asarray(features["bpm"])         # no copy
+ *
+ * Inputs are read in place through the buffer protocol (NumPy arrays,
+ * array.array, memoryview...): 1-dimensional float32 or float64 values, and
+ * optional integer timestamps in microseconds. Outputs are memoryviews over
+ * buffers filled by the sensors, which np.asarray() wraps without copying.
+ *
+ * The GIL is released while processing, so sessions can be processed in
+ * parallel threads, with one sensor object per thread.
+ *
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "Heart.h"
+#include "SkinConductance.h"
+
+//=================================================BUFFERS=============================================//
+// Input buffer: 1-dimensional, any stride, read in place.
+struct Input {
+  Py_buffer view;
+  bool acquired;
+
+  Input() : acquired(false) {}
+  ~Input() {
+    if (acquired)
+      PyBuffer_Release(&view);
+  }
+
+  // Acquires object (None allowed if optional). Sets a Python error and
+  // returns false on failure.
+  bool acquire(PyObject* object, const char* name, bool isFloat) {
+    if (object == Py_None)
+      return true;
+    if (PyObject_GetBuffer(object, &view, PyBUF_RECORDS_RO) < 0)
+      return false;
+    acquired = true;
+    if (view.ndim != 1) {
+      PyErr_Format(PyExc_ValueError, "%s must be 1-dimensional", name);
+      return false;
+    }
+    char format = formatChar();
+    bool valid = isFloat ? (format == 'f' || format == 'd') :
+        (strchr("bBhHiIlLqQ", format) != NULL);
+    if (!valid) {
+      PyErr_Format(PyExc_TypeError, "%s: unsupported element type '%s'", name, view.format);
+      return false;
+    }
+    return true;
+  }
+
+  Py_ssize_t size() const {
+    return acquired ? view.shape[0] : 0;
+  }
+
+  char formatChar() const {
+    const char* format = view.format ? view.format : "B";
+    if (*format == '@' || *format == '=' || *format == '<')
+      format++;
+    return *format;
+  }
+
+  const char* at(Py_ssize_t i) const {
+    return static_cast<const char*>(view.buf) + i * view.strides[0];
+  }
+
+  float getFloat(Py_ssize_t i) const {
+    if (view.itemsize == sizeof(double)) {
+      double value;
+      memcpy(&value, at(i), sizeof(value));
+      return (float)value;
+    }
+    float value;
+    memcpy(&value, at(i), sizeof(value));
+    return value;
+  }
+
+  unsigned long getMicros(Py_ssize_t i) const {
+    const char* p = at(i);
+    switch (formatChar()) {
+      case 'b': { int8_t v;   memcpy(&v, p, sizeof(v)); return (unsigned long)v; }
+      case 'h': { int16_t v;  memcpy(&v, p, sizeof(v)); return (unsigned long)v; }
+      case 'H': { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+      case 'i': case 'I': if (view.itemsize == 4) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; } break;
+      default: break;
+    }
+    if (view.itemsize == 8) { uint64_t v; memcpy(&v, p, sizeof(v)); return (unsigned long)v; }
+    if (view.itemsize == 4) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+    return (unsigned char)*p;
+  }
+};
+
+// Output buffer: a bytearray filled without the GIL, returned as a memoryview.
+struct Output {
+  PyObject* bytes;
+  char* data;
+
+  Output() : bytes(NULL), data(NULL) {}
+  ~Output() { Py_XDECREF(bytes); }
+
+  bool allocate(Py_ssize_t n, size_t itemSize) {
+    bytes = PyByteArray_FromStringAndSize(NULL, n * itemSize);
+    if (!bytes)
+      return false;
+    data = PyByteArray_AS_STRING(bytes);
+    return true;
+  }
+
+  float* floats() { return reinterpret_cast<float*>(data); }
+  uint8_t* bytesData() { return reinterpret_cast<uint8_t*>(data); }
+
+  // Adds a memoryview with given format to dict. Returns false on error.
+  bool store(PyObject* dict, const char* key, const char* format) {
+    PyObject* raw = PyMemoryView_FromObject(bytes);
+    if (!raw)
+      return false;
+    PyObject* view = PyObject_CallMethod(raw, "cast", "s", format);
+    Py_DECREF(raw);
+    if (!view)
+      return false;
+    int result = PyDict_SetItemString(dict, key, view);
+    Py_DECREF(view);
+    return result == 0;
+  }
+};
+
+// Parses the (signal, timestamps) arguments of process().
+static bool parseInputs(PyObject* args, PyObject* kwargs, Input& signal, Input& timestamps) {
+  static const char* keywords[] = { "signal", "timestamps", NULL };
+  PyObject* signalObject;
+  PyObject* timestampsObject = Py_None;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", const_cast<char**>(keywords), &signalObject, &timestampsObject))
+    return false;
+  if (signalObject == Py_None) {
+    PyErr_SetString(PyExc_TypeError, "signal must not be None");
+    return false;
+  }
+  if (!signal.acquire(signalObject, "signal", true) || !timestamps.acquire(timestampsObject, "timestamps", false))
+    return false;
+  if (timestamps.acquired && timestamps.size() != signal.size()) {
+    PyErr_SetString(PyExc_ValueError, "timestamps and signal must have the same length");
+    return false;
+  }
+  return true;
+}
+
+// Time of a sample on the sample rate grid, in microseconds.
+static unsigned long sampleMicros(unsigned long long index, unsigned long rate) {
+  return (unsigned long)(index * 1000000ULL / rate);
+}
+
+// Objects created with __new__() alone have no sensor until __init__() runs.
+static bool initialized(const void* sensor) {
+  if (!sensor) {
+    PyErr_SetString(PyExc_RuntimeError, "sensor is not initialized (__init__() was not called)");
+    return false;
+  }
+  return true;
+}
+
+// Sensor objects are not thread-safe: refuse concurrent use rather than crash.
+static bool enter(bool& busy) {
+  if (busy) {
+    PyErr_SetString(PyExc_RuntimeError, "sensor is already processing in another thread");
+    return false;
+  }
+  busy = true;
+  return true;
+}
+
+//=================================================HEART=============================================//
+struct HeartObject {
+  PyObject_HEAD
+  Heart* heart;
+  unsigned long rate;
+  unsigned long long samples; // samples processed without timestamps
+  bool gating;
+  bool busy;
+};
+
+static int Heart_init(HeartObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = { "rate", "bandpass", "beat_thresholds", "min_max_smoothing", "quality_gating", NULL };
+  unsigned long rate = 200;
+  PyObject* bandpass = Py_None;
+  PyObject* thresholds = Py_None;
+  PyObject* smoothing = Py_None;
+  int gating = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|kOOOp", const_cast<char**>(keywords),
+                                   &rate, &bandpass, &thresholds, &smoothing, &gating))
+    return -1;
+  if (rate == 0) {
+    PyErr_SetString(PyExc_ValueError, "rate must be positive");
+    return -1;
+  }
+  // The sensor is replaced: it must not be processing without the GIL.
+  if (self->busy) {
+    PyErr_SetString(PyExc_RuntimeError, "sensor is already processing in another thread");
+    return -1;
+  }
+
+  delete self->heart;
+  self->heart = new Heart(rate);
+  self->rate = rate;
+  self->samples = 0;
+  self->gating = gating;
+  self->heart->setQualityGating(gating);
+
+  float low, high;
+  if (bandpass != Py_None) {
+    if (!PyArg_ParseTuple(bandpass, "ff", &low, &high))
+      return -1;
+    self->heart->setBandpass(low, high);
+  }
+  if (thresholds != Py_None) {
+    if (!PyArg_ParseTuple(thresholds, "ff", &low, &high))
+      return -1;
+    self->heart->setBeatThresholds(low, high);
+  }
+  if (smoothing != Py_None) {
+    double value = PyFloat_AsDouble(smoothing);
+    if (value == -1 && PyErr_Occurred())
+      return -1;
+    self->heart->setMinMaxSmoothing((float)value);
+  }
+  return 0;
+}
+
+static void Heart_dealloc(HeartObject* self) {
+  // Instances of heap types hold a reference to their type.
+  PyTypeObject* type = Py_TYPE(self);
+  delete self->heart;
+  type->tp_free(reinterpret_cast<PyObject*>(self));
+  Py_DECREF(type);
+}
+
+static PyObject* Heart_process(HeartObject* self, PyObject* args, PyObject* kwargs) {
+  if (!initialized(self->heart))
+    return NULL;
+  Input signal, timestamps;
+  if (!parseInputs(args, kwargs, signal, timestamps))
+    return NULL;
+
+  Py_ssize_t n = signal.size();
+  Output beat, normalized, bpm, amplitudeChange, bpmChange, good;
+  if (!beat.allocate(n, 1) || !normalized.allocate(n, 4) || !bpm.allocate(n, 4) ||
+      !amplitudeChange.allocate(n, 4) || !bpmChange.allocate(n, 4) || !good.allocate(self->gating ? n : 0, 1))
+    return NULL;
+
+  if (!enter(self->busy))
+    return NULL;
+  Heart& heart = *self->heart;
+  Py_BEGIN_ALLOW_THREADS
+  for (Py_ssize_t i = 0; i < n; i++) {
+    if (timestamps.acquired)
+      heart.update(signal.getFloat(i), timestamps.getMicros(i));
+    else {
+      // Samples on the sample rate grid, as with update() on the device.
+      heart.sample(signal.getFloat(i), sampleMicros(self->samples++, self->rate));
+    }
+    beat.bytesData()[i] = heart.beatDetected();
+    normalized.floats()[i] = heart.getNormalized();
+    bpm.floats()[i] = heart.getBPM();
+    amplitudeChange.floats()[i] = heart.amplitudeChange();
+    bpmChange.floats()[i] = heart.bpmChange();
+    if (self->gating)
+      good.bytesData()[i] = heart.getQuality().isGood();
+  }
+  Py_END_ALLOW_THREADS
+  self->busy = false;
+
+  PyObject* result = PyDict_New();
+  if (!result)
+    return NULL;
+  if (!beat.store(result, "beat", "B") || !normalized.store(result, "normalized", "f") ||
+      !bpm.store(result, "bpm", "f") || !amplitudeChange.store(result, "amplitude_change", "f") ||
+      !bpmChange.store(result, "bpm_change", "f") || (self->gating && !good.store(result, "good", "B"))) {
+    Py_DECREF(result);
+    return NULL;
+  }
+  return result;
+}
+
+static PyObject* Heart_reset(HeartObject* self, PyObject*) {
+  if (!initialized(self->heart) || !enter(self->busy))
+    return NULL;
+  self->heart->initialize(self->rate);
+  self->samples = 0;
+  self->busy = false;
+  Py_RETURN_NONE;
+}
+
+static PyObject* Heart_getBpm(HeartObject* self, void*) {
+  if (!initialized(self->heart))
+    return NULL;
+  return PyFloat_FromDouble(self->heart->getBPM());
+}
+
+static PyMethodDef Heart_methods[] = {
+  { "process", (PyCFunction)(void(*)(void))Heart_process, METH_VARARGS | METH_KEYWORDS,
+    "process(signal, timestamps=None) -> dict of beat, normalized, bpm, amplitude_change, bpm_change\n"
+    "(and good, the signal quality of each sample, with quality gating)\n\n"
+    "Processes samples taken at the sample rate, or at the given timestamps (microseconds).\n"
+    "State carries over between calls." },
+  { "reset", (PyCFunction)Heart_reset, METH_NOARGS, "Restarts calibration." },
+  { NULL, NULL, 0, NULL }
+};
+
+static PyGetSetDef Heart_getset[] = {
+  { "bpm", (getter)Heart_getBpm, NULL, "Current beats per minute.", NULL },
+  { NULL, NULL, NULL, NULL, NULL }
+};
+
+static PyType_Slot Heart_slots[] = {
+  { Py_tp_doc, const_cast<char*>(
+      "Heart(rate=200, bandpass=None, beat_thresholds=None, min_max_smoothing=None, quality_gating=False)\n\n"
+      "Photoplethysmograph processing, as the Heart class of the Arduino library.") },
+  { Py_tp_new, reinterpret_cast<void*>(PyType_GenericNew) },
+  { Py_tp_init, reinterpret_cast<void*>(Heart_init) },
+  { Py_tp_dealloc, reinterpret_cast<void*>(Heart_dealloc) },
+  { Py_tp_methods, Heart_methods },
+  { Py_tp_getset, Heart_getset },
+  { 0, NULL }
+};
+
+static PyType_Spec HeartSpec = {
+  "biodata.Heart", sizeof(HeartObject), 0, Py_TPFLAGS_DEFAULT, Heart_slots
+};
+
+//=================================================SKIN CONDUCTANCE=============================================//
+// Processing for any supported ADC resolution.
+struct SkinConductanceProcessor {
+  virtual ~SkinConductanceProcessor() {}
+  virtual void initialize(unsigned long rate) = 0;
+  virtual void sample(float signal, unsigned long timestampMicros) = 0;
+  virtual void update(float signal, unsigned long timestampMicros) = 0;
+  virtual float getSCR() const = 0;
+  virtual float getSCL() const = 0;
+  virtual void setQualityGating(bool enabled) = 0;
+  virtual bool isGood() const = 0;
+  bool response;
+};
+
+static void onResponse(const BioEvent&, void* processor) {
+  static_cast<SkinConductanceProcessor*>(processor)->response = true;
+}
+
+template <uint8_t ADC_BITS>
+struct SkinConductanceImplementation : SkinConductanceProcessor {
+  BasicSkinConductance< SkinConductanceConfig<ADC_BITS> > sensor;
+  SkinConductanceImplementation(unsigned long rate) : sensor(rate) {
+    sensor.setEventHandler(onResponse, static_cast<SkinConductanceProcessor*>(this));
+  }
+  void initialize(unsigned long rate) { sensor.initialize(rate); }
+  void sample(float signal, unsigned long t) { sensor.sample(signal, t); }
+  void update(float signal, unsigned long t) { sensor.update(signal, t); }
+  float getSCR() const { return sensor.getSCR(); }
+  float getSCL() const { return sensor.getSCL(); }
+  void setQualityGating(bool enabled) { sensor.setQualityGating(enabled); }
+  bool isGood() const { return sensor.getQuality().isGood(); }
+};
+
+struct SkinConductanceObject {
+  PyObject_HEAD
+  SkinConductanceProcessor* sensor;
+  unsigned long rate;
+  unsigned long long samples;
+  bool gating;
+  bool busy;
+};
+
+static int SkinConductance_init(SkinConductanceObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = { "rate", "adc_bits", "quality_gating", NULL };
+  unsigned long rate = 50;
+  int bits = 10;
+  int gating = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|kip", const_cast<char**>(keywords), &rate, &bits, &gating))
+    return -1;
+  if (rate == 0) {
+    PyErr_SetString(PyExc_ValueError, "rate must be positive");
+    return -1;
+  }
+  // The sensor is replaced: it must not be processing without the GIL.
+  if (self->busy) {
+    PyErr_SetString(PyExc_RuntimeError, "sensor is already processing in another thread");
+    return -1;
+  }
+
+  SkinConductanceProcessor* sensor;
+  switch (bits) {
+    case 10: sensor = new SkinConductanceImplementation<10>(rate); break;
+    case 12: sensor = new SkinConductanceImplementation<12>(rate); break;
+    case 13: sensor = new SkinConductanceImplementation<13>(rate); break;
+    case 15: sensor = new SkinConductanceImplementation<15>(rate); break;
+    case 16: sensor = new SkinConductanceImplementation<16>(rate); break;
+    default:
+      PyErr_SetString(PyExc_ValueError, "adc_bits must be 10, 12, 13, 15 or 16");
+      return -1;
+  }
+  delete self->sensor;
+  self->sensor = sensor;
+  self->rate = rate;
+  self->samples = 0;
+  self->gating = gating;
+  sensor->setQualityGating(gating);
+  return 0;
+}
+
+static void SkinConductance_dealloc(SkinConductanceObject* self) {
+  // Instances of heap types hold a reference to their type.
+  PyTypeObject* type = Py_TYPE(self);
+  delete self->sensor;
+  type->tp_free(reinterpret_cast<PyObject*>(self));
+  Py_DECREF(type);
+}
+
+static PyObject* SkinConductance_process(SkinConductanceObject* self, PyObject* args, PyObject* kwargs) {
+  if (!initialized(self->sensor))
+    return NULL;
+  Input signal, timestamps;
+  if (!parseInputs(args, kwargs, signal, timestamps))
+    return NULL;
+
+  Py_ssize_t n = signal.size();
+  Output response, scr, scl, good;
+  if (!response.allocate(n, 1) || !scr.allocate(n, 4) || !scl.allocate(n, 4) || !good.allocate(self->gating ? n : 0, 1))
+    return NULL;
+
+  if (!enter(self->busy))
+    return NULL;
+  SkinConductanceProcessor& sensor = *self->sensor;
+  Py_BEGIN_ALLOW_THREADS
+  for (Py_ssize_t i = 0; i < n; i++) {
+    sensor.response = false;
+    if (timestamps.acquired)
+      sensor.update(signal.getFloat(i), timestamps.getMicros(i));
+    else {
+      sensor.sample(signal.getFloat(i), sampleMicros(self->samples++, self->rate));
+    }
+    response.bytesData()[i] = sensor.response;
+    scr.floats()[i] = sensor.getSCR();
+    scl.floats()[i] = sensor.getSCL();
+    if (self->gating)
+      good.bytesData()[i] = sensor.isGood();
+  }
+  Py_END_ALLOW_THREADS
+  self->busy = false;
+
+  PyObject* result = PyDict_New();
+  if (!result)
+    return NULL;
+  if (!response.store(result, "response", "B") || !scr.store(result, "scr", "f") || !scl.store(result, "scl", "f") ||
+      (self->gating && !good.store(result, "good", "B"))) {
+    Py_DECREF(result);
+    return NULL;
+  }
+  return result;
+}
+
+static PyObject* SkinConductance_reset(SkinConductanceObject* self, PyObject*) {
+  if (!initialized(self->sensor) || !enter(self->busy))
+    return NULL;
+  self->sensor->initialize(self->rate);
+  self->samples = 0;
+  self->busy = false;
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef SkinConductance_methods[] = {
+  { "process", (PyCFunction)(void(*)(void))SkinConductance_process, METH_VARARGS | METH_KEYWORDS,
+    "process(signal, timestamps=None) -> dict of response, scr, scl\n"
+    "(and good, the signal quality of each sample, with quality gating)\n\n"
+    "Processes samples taken at the sample rate, or at the given timestamps (microseconds).\n"
+    "State carries over between calls." },
+  { "reset", (PyCFunction)SkinConductance_reset, METH_NOARGS, "Restarts the baselines." },
+  { NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot SkinConductance_slots[] = {
+  { Py_tp_doc, const_cast<char*>(
+      "SkinConductance(rate=50, adc_bits=10, quality_gating=False)\n\n"
+      "Skin conductance processing, as the SkinConductance class of the Arduino library.") },
+  { Py_tp_new, reinterpret_cast<void*>(PyType_GenericNew) },
+  { Py_tp_init, reinterpret_cast<void*>(SkinConductance_init) },
+  { Py_tp_dealloc, reinterpret_cast<void*>(SkinConductance_dealloc) },
+  { Py_tp_methods, SkinConductance_methods },
+  { 0, NULL }
+};
+
+static PyType_Spec SkinConductanceSpec = {
+  "biodata.SkinConductance", sizeof(SkinConductanceObject), 0, Py_TPFLAGS_DEFAULT, SkinConductance_slots
+};
+
+//=================================================MODULE=============================================//
+static struct PyModuleDef module = {
+  PyModuleDef_HEAD_INIT, "biodata",
+  "BioData sensors (Heart, SkinConductance) for offline analysis.", -1, NULL,
+  NULL, NULL, NULL, NULL
+};
+
+// Adds a type built from spec to module. Returns false on error.
+static bool addType(PyObject* module, const char* name, PyType_Spec* spec) {
+  PyObject* type = PyType_FromSpec(spec);
+  if (!type)
+    return false;
+  if (PyModule_AddObject(module, name, type) < 0) {
+    Py_DECREF(type);
+    return false;
+  }
+  return true;
+}
+
+PyMODINIT_FUNC PyInit_biodata(void) {
+  PyObject* m = PyModule_Create(&module);
+  if (!m)
+    return NULL;
+  if (!addType(m, "Heart", &HeartSpec) || !addType(m, "SkinConductance", &SkinConductanceSpec)) {
+    Py_DECREF(m);
+    return NULL;
+  }
+  return m;
+}
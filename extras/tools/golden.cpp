@@ -0,0 +1,223 @@
+/*
+ * golden.cpp
+ *
+ * Runs the sensors on synthetic signals (see SignalGenerator.h) and compares
+ * their outputs with the corpus in extras/tools/golden, so that changes to
+ * the processing can be checked for equivalence.
+ *
+ *   biodata_golden                # checks against the corpus
+ *   biodata_golden --update       # regenerates the corpus
+ *   biodata_golden [--update] dir # uses another corpus directory
+ *
+ * Returns 0 if all outputs match. ctest runs it as the golden test (see
+ * tests/CMakeLists.txt). Respiration is not covered, since Plaquette does
+ * not build on computers.
+ *
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Heart.h"
+#include "SignalGenerator.h"
+#include "SkinConductance.h"
+
+#ifndef BIODATA_GOLDEN_DIR
+#define BIODATA_GOLDEN_DIR "golden"
+#endif
+
+// Seed of all signals in the corpus.
+static const uint32_t SEED = 1;
+
+// Outputs may differ by this much (absolute + relative) between compilers.
+static const double TOLERANCE = 1e-4;
+
+typedef std::vector<std::string> Lines;
+
+static void addLine(Lines& lines, const char* format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  lines.push_back(line);
+}
+
+//=================================================CASES=============================================//
+// Heart: logs every 20th sample (10 Hz) and every beat.
+static void runHeart(Lines& lines, Heart& heart, unsigned int seconds) {
+  PulseGenerator ppg(200, SEED);
+  addLine(lines, "sample,beat,normalized,bpm,amplitudeChange,bpmChange");
+  for (unsigned long n = 0; n < 200UL * seconds; n++) {
+    heart.sample(ppg.next(), ppg.getMicros());
+    if (n % 20 == 0 || heart.beatDetected())
+      addLine(lines, "%lu,%d,%.6g,%.6g,%.6g,%.6g", n, heart.beatDetected(),
+              heart.getNormalized(), heart.getBPM(), heart.amplitudeChange(), heart.bpmChange());
+  }
+}
+
+static void heartCase(Lines& lines) {
+  Heart heart(200);
+  runHeart(lines, heart, 60);
+}
+
+static void heartBandpassCase(Lines& lines) {
+  Heart heart(200);
+  heart.setBandpass(0.5, 8);
+  heart.setTrendDecimation(4);
+  runHeart(lines, heart, 60);
+}
+
+static void onResponse(const BioEvent&, void* response) {
+  *static_cast<bool*>(response) = true;
+}
+
+// SkinConductance: logs every 10th sample (5 Hz) and every response onset.
+static void skinConductanceCase(Lines& lines) {
+  SkinConductanceGenerator eda(50, SEED);
+  SkinConductance sc(50);
+  bool response = false;
+  sc.setEventHandler(onResponse, &response);
+  addLine(lines, "sample,response,scr,scl");
+  for (unsigned long n = 0; n < 50UL * 120; n++) {
+    response = false;
+    sc.sample(eda.next(), eda.getMicros());
+    if (n % 10 == 0 || response)
+      addLine(lines, "%lu,%d,%.6g,%.6g", n, response, sc.getSCR(), sc.getSCL());
+  }
+}
+
+struct Case {
+  const char* name;
+  void (*run)(Lines&);
+};
+
+static const Case cases[] = {
+  { "heart",            heartCase },
+  { "heart_bandpass",   heartBandpassCase },
+  { "skin_conductance", skinConductanceCase },
+};
+
+//=================================================FILES=============================================//
+static bool readLines(const std::string& path, Lines& lines) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (!file)
+    return false;
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    line[strcspn(line, "\r\n")] = 0;
+    lines.push_back(line);
+  }
+  fclose(file);
+  return true;
+}
+
+static bool writeLines(const std::string& path, const Lines& lines) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (!file)
+    return false;
+  for (size_t i = 0; i < lines.size(); i++)
+    fprintf(file, "%s\n", lines[i].c_str());
+  return fclose(file) == 0;
+}
+
+// Compares two CSV lines field by field. Returns the largest difference
+// (relative to the tolerance) or HUGE_VAL if the fields do not match.
+static double compareLines(const std::string& expected, const std::string& actual) {
+  if (expected == actual)
+    return 0;
+  double worst = 0;
+  const char* e = expected.c_str();
+  const char* a = actual.c_str();
+  for (;;) {
+    char* eEnd;
+    char* aEnd;
+    double x = strtod(e, &eEnd);
+    double y = strtod(a, &aEnd);
+    if (eEnd == e || aEnd == a)
+      return HUGE_VAL;
+    double error = fabs(x - y) / (TOLERANCE * (1 + fabs(x)));
+    if (!(error <= worst)) worst = error; // also catches NaN
+    if (*eEnd != *aEnd)
+      return HUGE_VAL;
+    if (*eEnd == 0)
+      return worst;
+    e = eEnd + 1;
+    a = aEnd + 1;
+  }
+}
+
+static bool check(const std::string& path, const Lines& actual) {
+  Lines expected;
+  if (!readLines(path, expected)) {
+    printf("%s: cannot read (run with --update to create it)\n", path.c_str());
+    return false;
+  }
+  if (expected.size() != actual.size()) {
+    printf("%s: %zu lines instead of %zu\n", path.c_str(), actual.size(), expected.size());
+    return false;
+  }
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (compareLines(expected[i], actual[i]) > 1) {
+      printf("%s:%zu: mismatch\n  expected: %s\n  actual:   %s\n", path.c_str(), i + 1,
+             expected[i].c_str(), actual[i].c_str());
+      return false;
+    }
+  }
+  printf("%s: ok (%zu lines)\n", path.c_str(), expected.size());
+  return true;
+}
+
+int main(int argc, char** argv) {
+  bool update = false;
+  std::string dir = BIODATA_GOLDEN_DIR;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--update") == 0)
+      update = true;
+    else if (argv[i][0] == '-') {
+      fprintf(stderr, "usage: %s [--update] [corpus directory]\n", argv[0]);
+      return 2;
+    }
+    else
+      dir = argv[i];
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    Lines lines;
+    cases[i].run(lines);
+    std::string path = dir + "/" + cases[i].name + ".csv";
+    if (update) {
+      if (writeLines(path, lines))
+        printf("%s: written (%zu lines)\n", path.c_str(), lines.size());
+      else {
+        printf("%s: cannot write\n", path.c_str());
+        ok = false;
+      }
+    }
+    else if (!check(path, lines))
+      ok = false;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+/*
+ * synth.cpp
+ *
+ * Writes synthetic sensor signals (see SignalGenerator.h) as CSV, eg. to
+ * feed other programs or plot them:
+ *
+ *   biodata_synth pulse 60            # 60 seconds of PPG at 200 Hz, seed 1
+ *   biodata_synth skin 600 7          # 10 minutes of skin conductance, seed 7
+ *   biodata_synth respiration 300 1 100
+ *
+ * Columns: time (microseconds), value (ADC units), event (1 at each beat,
+ * response onset or exhalation onset).
+ *
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SignalGenerator.h"
+
+template <class Generator>
+static void write(Generator& generator, unsigned long seconds, bool (Generator::*event)() const) {
+  unsigned long n = seconds * generator.getSampleRate();
+  printf("micros,value,event\n");
+  for (unsigned long i = 0; i < n; i++) {
+    float value = generator.next();
+    printf("%lu,%.0f,%d\n", generator.getMicros(), value, (generator.*event)());
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s pulse|skin|respiration seconds [seed] [rate]\n", argv[0]);
+    return 2;
+  }
+  const char* signal = argv[1];
+  unsigned long seconds = strtoul(argv[2], NULL, 10);
+  uint32_t seed = argc > 3 ? strtoul(argv[3], NULL, 10) : 1;
+  unsigned long rate = argc > 4 ? strtoul(argv[4], NULL, 10) : 0;
+
+  if (strcmp(signal, "pulse") == 0) {
+    PulseGenerator generator(rate ? rate : 200, seed);
+    write(generator, seconds, &PulseGenerator::beatOccurred);
+  }
+  else if (strcmp(signal, "skin") == 0) {
+    SkinConductanceGenerator generator(rate ? rate : 50, seed);
+    write(generator, seconds, &SkinConductanceGenerator::responseOccurred);
+  }
+  else if (strcmp(signal, "respiration") == 0) {
+    RespirationGenerator generator(rate ? rate : 50, seed);
+    write(generator, seconds, &RespirationGenerator::breathOccurred);
+  }
+  else {
+    fprintf(stderr, "unknown signal: %s\n", signal);
+    return 2;
+  }
+  return 0;
+}
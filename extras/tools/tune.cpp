@@ -0,0 +1,491 @@
+/*
+ * tune.cpp
+ *
+ * Searches the beat detection parameters of Heart over a set of sessions
+ * with reference beat annotations, using all cores:
+ *
+ *   biodata_tune --low 0.1:0.4:0.05 --high 0.3:0.7:0.05 session1.csv session2.csv
+ *   biodata_tune --random 500 --low 0.1:0.4 --high 0.3:0.7 --smoothing 0.01:0.3
+ *   biodata_tune --amplitude-smoothing 0.0005:0.01:0.0005 --bpm-smoothing 0.0005:0.01:0.0005
+ *
+ * Sessions are CSV files with columns time (microseconds), value and event
+ * (1 at each reference beat), as written by biodata_synth. Without session
+ * files, eight synthetic sessions with different heart rates and noise
+ * levels are used.
+ *
+ * Each configuration is scored on all sessions: a detection counts as a
+ * true positive if it follows a reference beat by less than the matching
+ * window. Configurations are listed by F1 score, with the mean BPM error
+ * and the processing cost per sample.
+ *
+ * When the Lop smoothing factors of the amplitude or BPM trends are
+ * searched, the trends are computed as well and scored by their
+ * correlation, at each reference beat, with the reference BPM (from the
+ * beat interval) and the reference amplitude (peak-to-peak signal over the
+ * interval). Configurations with the same beat detection score are then
+ * listed by the mean of both correlations.
+ *
+ * Respiration thresholds cannot be searched: Respiration depends on the
+ * Plaquette library, which does not build on computers.
+ *
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "Heart.h"
+#include "SignalGenerator.h"
+
+//=================================================SESSIONS=============================================//
+// Decoded session, shared read-only by all workers.
+struct Session {
+  const char* name;
+  unsigned long rate;
+  std::vector<float> values;
+  std::vector<unsigned long> micros;
+  std::vector<unsigned long> beats; // reference beat times
+};
+
+static bool loadSession(const char* path, Session& session) {
+  FILE* file = fopen(path, "r");
+  if (!file)
+    return false;
+  session.name = path;
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    unsigned long t;
+    float value;
+    int event = 0;
+    if (sscanf(line, "%lu,%f,%d", &t, &value, &event) < 2)
+      continue; // header or blank line
+    session.micros.push_back(t);
+    session.values.push_back(value);
+    if (event)
+      session.beats.push_back(t);
+  }
+  fclose(file);
+
+  size_t n = session.micros.size();
+  if (n < 2 || session.micros[n - 1] <= session.micros[0])
+    return false;
+  double period = double(session.micros[n - 1] - session.micros[0]) / (n - 1);
+  session.rate = (unsigned long)(1e6 / period + 0.5);
+  return true;
+}
+
+static void syntheticSession(Session& session, uint32_t seed, unsigned int k) {
+  static const char* const names[] = { "synthetic-1", "synthetic-2", "synthetic-3", "synthetic-4",
+                                       "synthetic-5", "synthetic-6", "synthetic-7", "synthetic-8" };
+  PulseGenerator ppg(200);
+  ppg.setHeartRate(55 + 12 * k, 4, 0.03f);
+  ppg.setNoise(2 + 2 * k);
+  ppg.restart(seed + k);
+  session.name = names[k];
+  session.rate = ppg.getSampleRate();
+  for (unsigned long n = 0; n < 120 * session.rate; n++) {
+    session.values.push_back(ppg.next());
+    session.micros.push_back(ppg.getMicros());
+    if (ppg.beatOccurred())
+      session.beats.push_back(ppg.getMicros());
+  }
+}
+
+//=================================================CONFIGURATIONS=============================================//
+struct Range {
+  float low, high, step;
+};
+
+struct Config {
+  float low;                // beat threshold low bound
+  float high;               // beat threshold high bound
+  float smoothing;          // min-max smoothing
+  float amplitudeSmoothing; // amplitude trend Lop smoothing
+  float bpmSmoothing;       // BPM trend Lop smoothing
+};
+
+struct Result {
+  Config config;
+  unsigned long truePositives, falsePositives, falseNegatives;
+  double bpmError;       // mean absolute error on true positives
+  double amplitudeTrend; // mean correlation of amplitudeChange() with the reference amplitude
+  double bpmTrend;       // mean correlation of bpmChange() with the reference BPM
+  double nanosPerSample;
+  double f1() const {
+    unsigned long n = 2 * truePositives + falsePositives + falseNegatives;
+    return n ? 2.0 * truePositives / n : 0;
+  }
+  double recall() const {
+    unsigned long n = truePositives + falseNegatives;
+    return n ? double(truePositives) / n : 0;
+  }
+  double precision() const {
+    unsigned long n = truePositives + falsePositives;
+    return n ? double(truePositives) / n : 0;
+  }
+};
+
+// Parses "value", "low:high" or "low:high:step".
+static bool parseRange(const char* text, Range& range) {
+  int n = sscanf(text, "%f:%f:%f", &range.low, &range.high, &range.step);
+  if (n < 1)
+    return false;
+  if (n == 1) range.high = range.low;
+  if (n < 3) range.step = 0;
+  return range.high >= range.low && range.step >= 0;
+}
+
+static std::vector<float> gridValues(const Range& range) {
+  std::vector<float> values;
+  if (range.step <= 0)
+    values.push_back(range.low);
+  else
+    for (int i = 0; range.low + i * range.step <= range.high + range.step * 1e-3f; i++)
+      values.push_back(range.low + i * range.step);
+  return values;
+}
+
+//=================================================EVALUATION=============================================//
+struct Options {
+  unsigned long windowMicros; // maximum delay between a reference beat and its detection
+  unsigned long warmupMicros; // beats during calibration are not scored
+  bool bandpass;
+  float bandpassLow, bandpassHigh;
+  bool trends;                // computes and scores the amplitude and BPM trends
+};
+
+// Pearson correlation of pairs (x, y); 0 if either does not vary.
+static double correlation(const std::vector<double>& x, const std::vector<double>& y) {
+  size_t n = x.size();
+  if (n < 2)
+    return 0;
+  double meanX = 0, meanY = 0;
+  for (size_t i = 0; i < n; i++) {
+    meanX += x[i];
+    meanY += y[i];
+  }
+  meanX /= n;
+  meanY /= n;
+  double xy = 0, xx = 0, yy = 0;
+  for (size_t i = 0; i < n; i++) {
+    xy += (x[i] - meanX) * (y[i] - meanY);
+    xx += (x[i] - meanX) * (x[i] - meanX);
+    yy += (y[i] - meanY) * (y[i] - meanY);
+  }
+  return xx > 0 && yy > 0 ? xy / sqrt(xx * yy) : 0;
+}
+
+// Correlations of the trend outputs with the reference at each reference
+// beat after start, added to amplitudeTrend and bpmTrend.
+static void scoreTrends(const Session& session, unsigned long start,
+                        const std::vector<float>& amplitudeChanges, const std::vector<float>& bpmChanges,
+                        double& amplitudeTrend, double& bpmTrend) {
+  const std::vector<unsigned long>& beats = session.beats;
+  std::vector<double> amplitudes, referenceAmplitudes, bpms, referenceBpms;
+  size_t i = 0;
+  for (size_t r = 1; r < beats.size(); r++) {
+    // Peak-to-peak signal over the beat interval.
+    while (i < session.micros.size() && session.micros[i] < beats[r - 1])
+      i++;
+    float lowest = INFINITY, highest = -INFINITY;
+    for (; i < session.micros.size() && session.micros[i] < beats[r]; i++) {
+      lowest = std::min(lowest, session.values[i]);
+      highest = std::max(highest, session.values[i]);
+    }
+    if (i == session.micros.size())
+      break;
+    if (beats[r] < start || highest < lowest)
+      continue;
+    amplitudes.push_back(amplitudeChanges[i]);
+    referenceAmplitudes.push_back(highest - lowest);
+    bpms.push_back(bpmChanges[i]);
+    referenceBpms.push_back(60e6 / (beats[r] - beats[r - 1]));
+  }
+  amplitudeTrend += correlation(amplitudes, referenceAmplitudes);
+  bpmTrend += correlation(bpms, referenceBpms);
+}
+
+static void evaluate(const Options& options, const std::vector<Session>& sessions, Result& result) {
+  const Config& config = result.config;
+  result.truePositives = result.falsePositives = result.falseNegatives = 0;
+  double bpmError = 0;
+  double amplitudeTrend = 0, bpmTrend = 0;
+  unsigned long nSamples = 0;
+  std::chrono::steady_clock::duration elapsed(0);
+
+  for (size_t s = 0; s < sessions.size(); s++) {
+    const Session& session = sessions[s];
+    const std::vector<unsigned long>& beats = session.beats;
+    unsigned long start = session.micros[0] + options.warmupMicros;
+
+    // Trend outputs are only computed when they are scored.
+    Heart heart(session.rate, options.trends ? HEART_AMPLITUDE_CHANGE | HEART_BPM_CHANGE : 0);
+    heart.setBeatThresholds(config.low, config.high);
+    heart.setMinMaxSmoothing(config.smoothing);
+    heart.setAmplitudeSmoothing(config.amplitudeSmoothing);
+    heart.setBpmSmoothing(config.bpmSmoothing);
+    if (options.bandpass)
+      heart.setBandpass(options.bandpassLow, options.bandpassHigh);
+
+    // Process first, then score, so that the cost only includes Heart.
+    std::vector<unsigned long> detections;
+    std::vector<float> bpms;
+    std::vector<float> amplitudeChanges(options.trends ? session.values.size() : 0);
+    std::vector<float> bpmChanges(amplitudeChanges.size());
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < session.values.size(); i++) {
+      heart.sample(session.values[i], session.micros[i]);
+      if (heart.beatDetected()) {
+        detections.push_back(session.micros[i]);
+        bpms.push_back(heart.getBPM());
+      }
+      if (options.trends) {
+        amplitudeChanges[i] = heart.amplitudeChange();
+        bpmChanges[i] = heart.bpmChange();
+      }
+    }
+    elapsed += std::chrono::steady_clock::now() - begin;
+    if (options.trends)
+      scoreTrends(session, start, amplitudeChanges, bpmChanges, amplitudeTrend, bpmTrend);
+    nSamples += session.values.size();
+
+    // Next reference beat not matched yet.
+    size_t r = 0;
+    while (r < beats.size() && beats[r] < start)
+      r++;
+    for (size_t d = 0; d < detections.size(); d++) {
+      unsigned long t = detections[d];
+      if (t < start)
+        continue;
+      while (r < beats.size() && beats[r] + options.windowMicros < t) {
+        result.falseNegatives++;
+        r++;
+      }
+      if (r < beats.size() && beats[r] <= t) {
+        result.truePositives++;
+        if (r > 0)
+          bpmError += fabs(bpms[d] - 60e6 / (beats[r] - beats[r - 1]));
+        r++;
+      }
+      else
+        result.falsePositives++;
+    }
+    result.falseNegatives += beats.size() - r;
+  }
+
+  result.bpmError = result.truePositives ? bpmError / result.truePositives : 0;
+  result.amplitudeTrend = sessions.empty() ? 0 : amplitudeTrend / sessions.size();
+  result.bpmTrend = sessions.empty() ? 0 : bpmTrend / sessions.size();
+  result.nanosPerSample = nSamples ?
+      std::chrono::duration<double, std::nano>(elapsed).count() / nSamples : 0;
+}
+
+static bool better(const Result& a, const Result& b) {
+  if (a.f1() != b.f1())
+    return a.f1() > b.f1();
+  if (a.bpmError != b.bpmError)
+    return a.bpmError < b.bpmError;
+  return a.amplitudeTrend + a.bpmTrend > b.amplitudeTrend + b.bpmTrend;
+}
+
+//=================================================MAIN=============================================//
+static int usage(const char* program) {
+  fprintf(stderr,
+          "usage: %s [options] [session.csv ...]\n"
+          "  --low RANGE        beat threshold low bound (default 0.25)\n"
+          "  --high RANGE       beat threshold high bound (default 0.4)\n"
+          "  --smoothing RANGE  min-max smoothing (default 0.1)\n"
+          "  --amplitude-smoothing RANGE  amplitude trend Lop smoothing (default 0.001)\n"
+          "  --bpm-smoothing RANGE        BPM trend Lop smoothing (default 0.001)\n"
+          "                     RANGE is value, min:max (random search) or min:max:step (grid);\n"
+          "                     either trend option also scores the trends\n"
+          "  --random N         evaluate N random configurations instead of the grid\n"
+          "  --bandpass LOW,HIGH  band-pass all configurations (Hz)\n"
+          "  --window MS        matching window after a reference beat (default 400)\n"
+          "  --warmup S         seconds not scored at the start of sessions (default 5)\n"
+          "  --seed N           seed of random search and synthetic sessions (default 1)\n"
+          "  --threads N        number of threads (default: all cores)\n"
+          "  --top N            number of configurations listed (default 10)\n"
+          "  --csv FILE         writes all results to FILE\n",
+          program);
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  Range low = { 0.25f, 0.25f, 0 };
+  Range high = { 0.4f, 0.4f, 0 };
+  Range smoothing = { 0.1f, 0.1f, 0 };
+  Range amplitudeSmoothing = { 0.001f, 0.001f, 0 };
+  Range bpmSmoothing = { 0.001f, 0.001f, 0 };
+  unsigned long nRandom = 0;
+  uint32_t seed = 1;
+  unsigned int nThreads = std::thread::hardware_concurrency();
+  size_t top = 10;
+  const char* csv = NULL;
+  Options options = { 400000UL, 5000000UL, false, 0, 0, false };
+  std::vector<const char*> paths;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (arg[0] != '-') {
+      paths.push_back(arg);
+      continue;
+    }
+    if (!value)
+      return usage(argv[0]);
+    i++;
+    if (strcmp(arg, "--low") == 0) {
+      if (!parseRange(value, low)) return usage(argv[0]);
+    }
+    else if (strcmp(arg, "--high") == 0) {
+      if (!parseRange(value, high)) return usage(argv[0]);
+    }
+    else if (strcmp(arg, "--smoothing") == 0) {
+      if (!parseRange(value, smoothing)) return usage(argv[0]);
+    }
+    else if (strcmp(arg, "--amplitude-smoothing") == 0) {
+      if (!parseRange(value, amplitudeSmoothing)) return usage(argv[0]);
+      options.trends = true;
+    }
+    else if (strcmp(arg, "--bpm-smoothing") == 0) {
+      if (!parseRange(value, bpmSmoothing)) return usage(argv[0]);
+      options.trends = true;
+    }
+    else if (strcmp(arg, "--bandpass") == 0) {
+      options.bandpass = true;
+      if (sscanf(value, "%f,%f", &options.bandpassLow, &options.bandpassHigh) != 2) return usage(argv[0]);
+    }
+    else if (strcmp(arg, "--random") == 0)  nRandom = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--window") == 0)  options.windowMicros = strtoul(value, NULL, 10) * 1000UL;
+    else if (strcmp(arg, "--warmup") == 0)  options.warmupMicros = (unsigned long)(atof(value) * 1e6);
+    else if (strcmp(arg, "--seed") == 0)    seed = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--threads") == 0) nThreads = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--top") == 0)     top = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--csv") == 0)     csv = value;
+    else return usage(argv[0]);
+  }
+  if (nThreads < 1)
+    nThreads = 1;
+
+  // Decode all sessions once.
+  std::vector<Session> sessions(paths.empty() ? 8 : paths.size());
+  for (size_t s = 0; s < sessions.size(); s++) {
+    if (paths.empty())
+      syntheticSession(sessions[s], seed, (unsigned int)s);
+    else if (!loadSession(paths[s], sessions[s])) {
+      fprintf(stderr, "%s: cannot read session\n", paths[s]);
+      return 1;
+    }
+  }
+
+  // Configurations.
+  std::vector<Result> results;
+  Result result = Result();
+  if (nRandom > 0) {
+    SignalRandom random(seed);
+    for (unsigned long i = 0; i < nRandom; i++) {
+      result.config.low = low.low + (low.high - low.low) * random.uniform();
+      result.config.high = high.low + (high.high - high.low) * random.uniform();
+      result.config.smoothing = smoothing.low + (smoothing.high - smoothing.low) * random.uniform();
+      result.config.amplitudeSmoothing = amplitudeSmoothing.low + (amplitudeSmoothing.high - amplitudeSmoothing.low) * random.uniform();
+      result.config.bpmSmoothing = bpmSmoothing.low + (bpmSmoothing.high - bpmSmoothing.low) * random.uniform();
+      if (result.config.low < result.config.high)
+        results.push_back(result);
+    }
+  }
+  else {
+    std::vector<float> lows = gridValues(low), highs = gridValues(high), smoothings = gridValues(smoothing);
+    std::vector<float> amplitudeSmoothings = gridValues(amplitudeSmoothing), bpmSmoothings = gridValues(bpmSmoothing);
+    for (size_t a = 0; a < lows.size(); a++)
+      for (size_t b = 0; b < highs.size(); b++)
+        for (size_t c = 0; c < smoothings.size(); c++)
+          for (size_t d = 0; d < amplitudeSmoothings.size(); d++)
+            for (size_t e = 0; e < bpmSmoothings.size(); e++) {
+              result.config.low = lows[a];
+              result.config.high = highs[b];
+              result.config.smoothing = smoothings[c];
+              result.config.amplitudeSmoothing = amplitudeSmoothings[d];
+              result.config.bpmSmoothing = bpmSmoothings[e];
+              if (result.config.low < result.config.high)
+                results.push_back(result);
+            }
+  }
+  if (results.empty()) {
+    fprintf(stderr, "no configuration to evaluate (low bound must be below high bound)\n");
+    return 1;
+  }
+
+  // Workers pull configurations until none are left.
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (unsigned int t = 0; t < nThreads && t < results.size(); t++)
+    workers.push_back(std::thread([&]() {
+      for (size_t i; (i = next++) < results.size(); )
+        evaluate(options, sessions, results[i]);
+    }));
+  for (size_t t = 0; t < workers.size(); t++)
+    workers[t].join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+  std::sort(results.begin(), results.end(), better);
+
+  size_t nBeats = 0;
+  for (size_t s = 0; s < sessions.size(); s++)
+    nBeats += sessions[s].beats.size();
+  printf("%zu configurations, %zu sessions (%zu reference beats), %u threads, %.2f s\n",
+         results.size(), sessions.size(), nBeats, (unsigned int)workers.size(), seconds);
+  printf("%8s %8s %10s %8s %8s %8s %9s %9s", "low", "high", "smoothing", "f1", "recall", "precision", "bpm err", "ns/sample");
+  if (options.trends)
+    printf(" %10s %10s %9s %9s", "amp lop", "bpm lop", "amp corr", "bpm corr");
+  printf("\n");
+  for (size_t i = 0; i < results.size() && i < top; i++) {
+    const Result& r = results[i];
+    printf("%8.4g %8.4g %10.4g %8.4f %8.4f %8.4f %9.3f %9.1f", r.config.low, r.config.high, r.config.smoothing,
+           r.f1(), r.recall(), r.precision(), r.bpmError, r.nanosPerSample);
+    if (options.trends)
+      printf(" %10.4g %10.4g %9.4f %9.4f", r.config.amplitudeSmoothing, r.config.bpmSmoothing, r.amplitudeTrend, r.bpmTrend);
+    printf("\n");
+  }
+
+  if (csv) {
+    FILE* file = fopen(csv, "w");
+    if (!file) {
+      fprintf(stderr, "%s: cannot write\n", csv);
+      return 1;
+    }
+    fprintf(file, "low,high,smoothing,amplitudeSmoothing,bpmSmoothing,truePositives,falsePositives,falseNegatives,"
+                  "f1,bpmError,amplitudeTrend,bpmTrend,nanosPerSample\n");
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result& r = results[i];
+      fprintf(file, "%g,%g,%g,%g,%g,%lu,%lu,%lu,%g,%g,%g,%g,%g\n", r.config.low, r.config.high, r.config.smoothing,
+              r.config.amplitudeSmoothing, r.config.bpmSmoothing, r.truePositives, r.falsePositives, r.falseNegatives,
+              r.f1(), r.bpmError, r.amplitudeTrend, r.bpmTrend, r.nanosPerSample);
+    }
+    fclose(file);
+  }
+  return 0;
+}
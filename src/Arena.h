@@ -0,0 +1,153 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Bump allocator placing many objects in a single block of memory, eg. the
+ * sensors of thousands of subjects on a server:
+ *
+ *   struct Subject { Heart heart; SkinConductance skin; Subject() : heart(200), skin(50) {} };
+ *   Arena arena(10000 * sizeof(Subject) + 4096); // one allocation
+ *   Subject* subjects = arena.createArray<Subject>(10000);
+ *   ...
+ *   arena.reset(); // or destroy the arena: the whole cohort is released at once
+ *
+ * Objects are laid out one after the other, so each subject's sensors sit in
+ * one contiguous block and subjects are contiguous in memory. Buffers can be
+ * taken from the arena as well, eg. for an Average:
+ *
+ *   Average<float>* average = arena.create< Average<float> >(64, arena.allocateArray<float>(64));
+ *
+ * Destructors of objects created in an arena are never called, so only
+ * create objects that own no other resources:
+ *
+ *  - Heart, SkinConductance and the filters qualify;
+ *  - Average only when given its buffer, and if its quantiles are used
+ *    (median(), percentile(), quantile()), their storage as well, or the
+ *    tree allocated on the first query leaks:
+ *      average->setQuantileStorage(arena.allocate(Average<float>::quantileStorageSize(64)));
+ *  - BioData and Respiration do not: their Plaquette units register
+ *    themselves with Plaquette and allocate, and must be destroyed.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(ARDUINO) && defined(__AVR__)
+#include <new.h>
+#else
+#include <new>
+#endif
+
+class Arena {
+  uint8_t* buffer;
+  size_t capacity;
+  size_t used;
+  bool owned;
+
+public:
+  /// Default alignment of allocate().
+  enum { DEFAULT_ALIGNMENT = alignof(long double) };
+
+  /// Constructor: arena in memory provided by the caller (eg. a static array).
+  Arena(void* buffer_, size_t size) : buffer(static_cast<uint8_t*>(buffer_)), capacity(size), used(0), owned(false) {}
+
+  /// Constructor: allocates size bytes at once (check getCapacity() for failure).
+  explicit Arena(size_t size) : used(0), owned(true) {
+    buffer = static_cast<uint8_t*>(malloc(size));
+    capacity = buffer ? size : 0;
+  }
+
+  ~Arena() {
+    if (owned)
+      free(buffer);
+  }
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  /// Returns size bytes aligned on alignment (a power of 2), or NULL if the arena is full.
+  void* allocate(size_t size, size_t alignment=DEFAULT_ALIGNMENT) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(buffer) + used;
+    size_t padding = (alignment - (address & (alignment - 1))) & (alignment - 1);
+    if (!buffer || padding + size > capacity - used)
+      return NULL;
+    used += padding + size;
+    return reinterpret_cast<void*>(address + padding);
+  }
+
+  /// Returns an uninitialized array of n T, or NULL if the arena is full.
+  template <class T>
+  T* allocateArray(size_t n) {
+    return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+  }
+
+  /// Constructs a T with the given constructor arguments. Returns NULL if the arena is full.
+  template <class T, class... Args>
+  T* create(Args&&... args) {
+    void* memory = allocate(sizeof(T), alignof(T));
+    return memory ? new (memory) T(static_cast<Args&&>(args)...) : NULL;
+  }
+
+  /**
+   * Constructs n contiguous T, each with the same constructor arguments.
+   * Returns NULL (and constructs nothing) if the arena is full.
+   */
+  template <class T, class... Args>
+  T* createArray(size_t n, const Args&... args) {
+    T* objects = allocateArray<T>(n);
+    if (objects)
+      for (size_t i = 0; i < n; i++)
+        new (objects + i) T(args...);
+    return objects;
+  }
+
+  /// Returns current position, to release everything allocated after it with release().
+  size_t mark() const {
+    return used;
+  }
+
+  /// Releases everything allocated since mark (destructors are not called).
+  void release(size_t mark) {
+    if (mark < used)
+      used = mark;
+  }
+
+  /// Releases everything (destructors are not called).
+  void reset() {
+    used = 0;
+  }
+
+  /// Returns size of the arena in bytes.
+  size_t getCapacity() const {
+    return capacity;
+  }
+
+  /// Returns number of bytes used (including alignment padding).
+  size_t getUsed() const {
+    return used;
+  }
+
+  /// Returns number of bytes left.
+  size_t getRemaining() const {
+    return capacity - used;
+  }
+};
+
+#endif
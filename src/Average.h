@@ -40,6 +40,12 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CompensatedSum.h"
+#include "State.h"
+#include "Summary.h"
 
 inline static float sqr(float x) {
     return x*x;
@@ -51,17 +57,63 @@ template <class T> class Average {
         // by functions within the class.
         T *_store;
         T _sum;                                               // _sum variable for faster mean calculation
+        T _compensation;                                      // low-order part of _sum lost to rounding (floating point T)
         uint32_t _position;                                   // _position variable for circular buffer
+
+        // Moments of the window for summary(), relative to _offset (the first
+        // value pushed after clear()) to limit cancellation, with the oldest
+        // value at index 0. Compensated like _sum.
+        double _offset;
+        double _shifted, _shiftedCompensation;                // sum of (value - _offset)
+        double _squares, _squaresCompensation;                // sum of (value - _offset)^2
+        double _weighted, _weightedCompensation;              // sum of index * (value - _offset)
         uint32_t _count;
         uint32_t _size;
+        bool _owned;                                          // true if _store was allocated by the constructor
+
+        // Order statistics for median() and quantile(): a treap (randomized
+        // binary search tree) of the stored values ordered by (value, slot),
+        // with one node per slot of _store and subtree sizes for rank queries.
+        // Built on the first quantile query, then updated by push() in
+        // O(log n) expected time.
+        struct _Node {
+            uint32_t left;
+            uint32_t right;
+            uint32_t size;
+            uint32_t priority;
+        };
+        static const uint32_t _NIL = 0xFFFFFFFF;
+        _Node *_nodes;
+        uint32_t _root;
+        uint32_t _random;
+        bool _nodesOwned;
+
+        void _accumulate(T value);
+        void _accumulateBlock(const T *entries, const T *evicted, uint32_t n);
+        void _blockMoments(const T *values, uint32_t n, uint32_t index, double &sum, double &weighted, double &squares) const;
+        void _clearMoments();
+        void _init();
+        bool _buildTree();
+        void _rebuildTree();
+        bool _before(uint32_t a, uint32_t b) const;
+        uint32_t _treeSize(uint32_t node) const;
+        void _updateSize(uint32_t node);
+        void _split(uint32_t node, uint32_t key, uint32_t &left, uint32_t &right);
+        uint32_t _merge(uint32_t left, uint32_t right);
+        void _add(uint32_t slot);
+        uint32_t _insert(uint32_t node, uint32_t slot);
+        uint32_t _erase(uint32_t node, uint32_t slot);
+        T _select(uint32_t rank) const;
 
     public:
         // Public functions and variables.  These can be accessed from
         // outside the class.
         Average(uint32_t size);
+        Average(uint32_t size, T *buffer);                    // uses buffer (size entries) instead of allocating
         ~Average();
         float rolling(T entry);
         void push(T entry);
+        void pushBlock(const T *entries, uint32_t n);         // same as push() on each entry, faster
         float mean();
         T mode();
         T minimum();
@@ -69,12 +121,20 @@ template <class T> class Average {
         T maximum();
         T maximum(int *);
         float stddev();
+        float median();                                       // median of the window
+        float quantile(float q);                              // q-quantile of the window (q in [0, 1]), interpolated
+        float percentile(float p);                            // p-th percentile of the window (p in [0, 100])
+        void setQuantileStorage(void *buffer);                // storage for quantiles, before first query (see quantileStorageSize())
+        static size_t quantileStorageSize(uint32_t size);     // bytes needed by setQuantileStorage()
         T get(uint32_t);
         void leastSquares(float &m, float &b, float &r);
         int getCount();
         T predict(int x);
         T sum();
+        Summary summary();                                    // mergeable summary of the window, oldest value first (O(1) but min/max)
         void clear();
+        void saveState(StateWriter &out) const;
+        bool loadState(StateReader &in);
         Average<T> &operator=(Average<T> &a);
 
 };
@@ -85,32 +145,177 @@ template <class T> int Average<T>::getCount() {
 
 template <class T> Average<T>::Average(uint32_t size) {
     _size = size;
-    _count = 0;
     _store = (T *)malloc(sizeof(T) * size);
+    _owned = true;
+    _init();
+}
+
+template <class T> Average<T>::Average(uint32_t size, T *buffer) {
+    _size = size;
+    _store = buffer;
+    _owned = false;
+    _init();
+}
+
+template <class T> void Average<T>::_init() {
+    _count = 0;
     _position = 0;                                            // track position for circular storage
     _sum = 0;                                                 // track sum for fast mean calculation
-    for (uint32_t i = 0; i < size; i++) {
+    _compensation = 0;
+    _clearMoments();
+    _nodes = NULL;
+    _root = _NIL;
+    _random = 2463534242UL;
+    _nodesOwned = false;
+    for (uint32_t i = 0; i < _size; i++) {
         _store[i] = 0;
     }
 }
 
 template <class T> Average<T>::~Average() {
-    free(_store);
+    if (_owned) {
+        free(_store);
+    }
+    if (_nodesOwned) {
+        free(_nodes);
+    }
+}
+
+// Adds value to _sum with Neumaier compensated summation (see
+// CompensatedSum.h), so that a sum updated forever by adding new values and
+// subtracting old ones does not drift away from the window contents.
+template <class T> void Average<T>::_accumulate(T value) {
+    compensatedAdd(_sum, _compensation, value);
+}
+
+template <class T> void Average<T>::_clearMoments() {
+    _offset = 0;
+    _shifted = _shiftedCompensation = 0;
+    _squares = _squaresCompensation = 0;
+    _weighted = _weightedCompensation = 0;
 }
 
 template <class T> void Average<T>::push(T entry) {
+    if (_count == 0) _offset = entry;
+    uint32_t index = _count;                                  // index of the new value in the window
     if (_count < _size) {                                     // adding new values to array
         _count++;                                             // count number of values in array
     } else {                                                    // overwriting old values
-        _sum = _sum -_store[_position];                       // remove old value from _sum
+        double old = _store[_position] - _offset;
+        compensatedAdd(_weighted, _weightedCompensation, old - (_shifted + _shiftedCompensation)); // the others move down one index
+        compensatedAdd(_shifted, _shiftedCompensation, -old);
+        compensatedAdd(_squares, _squaresCompensation, -old * old);
+        index--;
+        _accumulate(-_store[_position]);                      // remove old value from _sum
+        if (_nodes) _root = _erase(_root, _position);         // remove old value from order statistics
     }
     _store[_position] = entry;                                // store new value in array
-    _sum += entry;                                            // add the new value to _sum
+    double value = entry - _offset;
+    compensatedAdd(_shifted, _shiftedCompensation, value);
+    compensatedAdd(_squares, _squaresCompensation, value * value);
+    compensatedAdd(_weighted, _weightedCompensation, index * value);
+    _accumulate(entry);                                       // add the new value to _sum
+    if (_nodes) _add(_position);                              // add the new value to order statistics
     _position += 1;                                           // increment the position counter
     if (_position >= _size) _position = 0;                    // loop the position counter
 }
 
 
+// Copies the block into the ring with at most two memcpy() and updates _sum
+// with a few partial sums of the block. The moments are updated once from
+// the moments of the new and of the evicted values.
+template <class T> void Average<T>::pushBlock(const T *entries, uint32_t n) {
+    if (_nodes) {                                             // order statistics are updated one value at a time
+        for (uint32_t i = 0; i < n; i++) {
+            push(entries[i]);
+        }
+        return;
+    }
+    if (n >= _size) {                                         // only the last _size entries remain
+        clear();
+        entries += n - _size;
+        n = _size;
+    }
+
+    if (_count == 0 && n > 0) _offset = entries[0];
+    uint32_t evictFrom = _size - _count;                      // entries from this index overwrite stored values
+    double added = 0, addedWeighted = 0, addedSquares = 0;    // indices from 0 (first entry)
+    double removed = 0, removedWeighted = 0, removedSquares = 0; // indices from 0 (oldest value)
+    uint32_t done = 0;
+    while (done < n) {
+        uint32_t length = _size - _position;
+        if (length > n - done) length = n - done;
+        uint32_t fresh = evictFrom > done ? evictFrom - done : 0;
+        if (fresh > length) fresh = length;
+
+        const T *in = entries + done;
+        T *slot = _store + _position;
+        _accumulateBlock(in, NULL, fresh);
+        _accumulateBlock(in + fresh, slot + fresh, length - fresh);
+        _blockMoments(in, length, done, added, addedWeighted, addedSquares);
+        if (fresh < length) _blockMoments(slot + fresh, length - fresh, done + fresh - evictFrom, removed, removedWeighted, removedSquares);
+        memcpy(slot, in, sizeof(T) * length);
+
+        done += length;
+        _position += length;
+        if (_position >= _size) _position = 0;
+    }
+    // The kept values move down by the number evicted, and the new values
+    // follow them.
+    double evicted = n > evictFrom ? n - evictFrom : 0;
+    double kept = (double)_count - evicted;
+    double shifted = _shifted + _shiftedCompensation;
+    compensatedAdd(_weighted, _weightedCompensation, -removedWeighted);
+    compensatedAdd(_weighted, _weightedCompensation, -evicted * (shifted - removed));
+    compensatedAdd(_weighted, _weightedCompensation, kept * added);
+    compensatedAdd(_weighted, _weightedCompensation, addedWeighted);
+    compensatedAdd(_shifted, _shiftedCompensation, added);
+    compensatedAdd(_shifted, _shiftedCompensation, -removed);
+    compensatedAdd(_squares, _squaresCompensation, addedSquares);
+    compensatedAdd(_squares, _squaresCompensation, -removedSquares);
+
+    _count = (_count + n < _size) ? _count + n : _size;
+}
+
+// Adds the sum of entries minus the sum of evicted (if not NULL) to _sum.
+// Eight independent partial sums let the compiler vectorize the loops; each
+// is then added with compensation, like the tail.
+template <class T> void Average<T>::_accumulateBlock(const T *entries, const T *evicted, uint32_t n) {
+    T lanes[8] = { 0 };
+    uint32_t i = 0;
+    if (evicted) {
+        for (; i + 8 <= n; i += 8) {
+            for (uint32_t k = 0; k < 8; k++) {
+                lanes[k] += entries[i + k] - evicted[i + k];
+            }
+        }
+    } else {
+        for (; i + 8 <= n; i += 8) {
+            for (uint32_t k = 0; k < 8; k++) {
+                lanes[k] += entries[i + k];
+            }
+        }
+    }
+    for (; i < n; i++) {
+        _accumulate(entries[i]);
+        if (evicted) _accumulate(-evicted[i]);
+    }
+    for (uint32_t k = 0; k < 8; k++) {
+        _accumulate(lanes[k]);
+    }
+}
+
+// Adds the moments of n values (relative to _offset), the first one at index.
+template <class T> void Average<T>::_blockMoments(const T *values, uint32_t n, uint32_t index,
+                                                  double &sum, double &weighted, double &squares) const {
+    for (uint32_t i = 0; i < n; i++) {
+        double value = values[i] - _offset;
+        sum += value;
+        weighted += (double)(index + i) * value;
+        squares += value * value;
+    }
+}
+
 template <class T> float Average<T>::rolling(T entry) {
     push(entry);
     return mean();
@@ -120,7 +325,7 @@ template <class T> float Average<T>::mean() {
     if (_count == 0) {
         return 0;
     }
-    return ((float)_sum / (float)_count);                     // mean calculation based on _sum
+    return ((float)(_sum + _compensation) / (float)_count);   // mean calculation based on _sum
 }
 
 template <class T> T Average<T>::mode() {
@@ -238,6 +443,168 @@ template <class T> float Average<T>::stddev() {
 	return sqrt(sum/(float)_count);
 }
 
+template <class T> float Average<T>::median() {
+    return quantile(0.5);
+}
+
+template <class T> float Average<T>::percentile(float p) {
+    return quantile(p / 100);
+}
+
+// Linear interpolation between the closest ranks (as in most spreadsheets).
+template <class T> float Average<T>::quantile(float q) {
+    if (_count == 0 || !_buildTree()) {
+        return 0;
+    }
+    if (q < 0) q = 0;
+    if (q > 1) q = 1;
+
+    float h = q * (_count - 1);
+    uint32_t rank = (uint32_t)h;
+    float low = (float)_select(rank);
+    if (rank + 1 >= _count) {
+        return low;
+    }
+    return low + (h - rank) * ((float)_select(rank + 1) - low);
+}
+
+template <class T> size_t Average<T>::quantileStorageSize(uint32_t size) {
+    return sizeof(_Node) * size;
+}
+
+template <class T> void Average<T>::setQuantileStorage(void *buffer) {
+    if (_nodesOwned) {
+        free(_nodes);
+    }
+    _nodes = (_Node *)buffer;
+    _nodesOwned = false;
+    _rebuildTree();
+}
+
+template <class T> void Average<T>::_rebuildTree() {
+    _root = _NIL;
+    if (_nodes) {
+        for (uint32_t i = 0; i < _count; i++) {
+            _add((_position + _size - _count + i) % _size);
+        }
+    }
+}
+
+// Allocates and fills the tree on first use.
+template <class T> bool Average<T>::_buildTree() {
+    if (_nodes) {
+        return true;
+    }
+    void *buffer = malloc(quantileStorageSize(_size));
+    if (!buffer) {
+        return false;
+    }
+    setQuantileStorage(buffer);
+    _nodesOwned = true;
+    return true;
+}
+
+// Strict order of slots: by value, then by slot to break ties.
+template <class T> bool Average<T>::_before(uint32_t a, uint32_t b) const {
+    return _store[a] < _store[b] || (!(_store[b] < _store[a]) && a < b);
+}
+
+template <class T> uint32_t Average<T>::_treeSize(uint32_t node) const {
+    return node == _NIL ? 0 : _nodes[node].size;
+}
+
+template <class T> void Average<T>::_updateSize(uint32_t node) {
+    _nodes[node].size = 1 + _treeSize(_nodes[node].left) + _treeSize(_nodes[node].right);
+}
+
+// Splits subtree into slots ordered before key and the others.
+template <class T> void Average<T>::_split(uint32_t node, uint32_t key, uint32_t &left, uint32_t &right) {
+    if (node == _NIL) {
+        left = right = _NIL;
+    } else if (_before(node, key)) {
+        _split(_nodes[node].right, key, _nodes[node].right, right);
+        left = node;
+        _updateSize(node);
+    } else {
+        _split(_nodes[node].left, key, left, _nodes[node].left);
+        right = node;
+        _updateSize(node);
+    }
+}
+
+// Joins two subtrees, all slots of left being ordered before those of right.
+template <class T> uint32_t Average<T>::_merge(uint32_t left, uint32_t right) {
+    if (left == _NIL) return right;
+    if (right == _NIL) return left;
+    if (_nodes[left].priority > _nodes[right].priority) {
+        _nodes[left].right = _merge(_nodes[left].right, right);
+        _updateSize(left);
+        return left;
+    } else {
+        _nodes[right].left = _merge(left, _nodes[right].left);
+        _updateSize(right);
+        return right;
+    }
+}
+
+// Adds slot to the tree with a random priority.
+template <class T> void Average<T>::_add(uint32_t slot) {
+    // xorshift32 priorities keep the tree balanced on average.
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    _nodes[slot].priority = _random;
+    _root = _insert(_root, slot);
+}
+
+template <class T> uint32_t Average<T>::_insert(uint32_t node, uint32_t slot) {
+    if (node == _NIL || _nodes[slot].priority > _nodes[node].priority) {
+        _split(node, slot, _nodes[slot].left, _nodes[slot].right);
+        _updateSize(slot);
+        return slot;
+    }
+    if (_before(slot, node)) {
+        _nodes[node].left = _insert(_nodes[node].left, slot);
+    } else {
+        _nodes[node].right = _insert(_nodes[node].right, slot);
+    }
+    _updateSize(node);
+    return node;
+}
+
+template <class T> uint32_t Average<T>::_erase(uint32_t node, uint32_t slot) {
+    if (node == _NIL) {
+        return _NIL;
+    }
+    if (node == slot) {
+        return _merge(_nodes[node].left, _nodes[node].right);
+    }
+    if (_before(slot, node)) {
+        _nodes[node].left = _erase(_nodes[node].left, slot);
+    } else {
+        _nodes[node].right = _erase(_nodes[node].right, slot);
+    }
+    _updateSize(node);
+    return node;
+}
+
+// Returns value of given rank (0 = smallest).
+template <class T> T Average<T>::_select(uint32_t rank) const {
+    uint32_t node = _root;
+    while (node != _NIL) {
+        uint32_t leftSize = _treeSize(_nodes[node].left);
+        if (rank < leftSize) {
+            node = _nodes[node].left;
+        } else if (rank == leftSize) {
+            return _store[node];
+        } else {
+            rank -= leftSize + 1;
+            node = _nodes[node].right;
+        }
+    }
+    return 0;
+}
+
 template <class T> T Average<T>::get(uint32_t index) {
     if (index >= _count) {
         return -1;
@@ -289,13 +656,81 @@ template <class T> T Average<T>::predict(int x) {
 
 // Return the sum of all the array items
 template <class T> T Average<T>::sum() {
-    return _sum;
+    return _sum + _compensation;
+}
+
+// Built from the moments kept by push(), in O(1) time. Minimum and maximum
+// come from the order statistics once median() or quantile() has been used
+// (O(log n)), and from one pass over the window otherwise.
+template <class T> Summary Average<T>::summary() {
+    if (_count == 0) {
+        return Summary();
+    }
+    double n = _count;
+    double shifted = _shifted + _shiftedCompensation;
+    double mean = shifted / n;
+    double m2 = (_squares + _squaresCompensation) - shifted * mean;
+    double xyM2 = (_weighted + _weightedCompensation) - (n - 1) / 2 * shifted;
+
+    T low, high;
+    if (_nodes) {
+        low = _select(0);
+        high = _select(_count - 1);
+    } else {
+        uint32_t slot = (_position + _size - _count) % _size;
+        low = high = _store[slot];
+        for (uint32_t i = 1; i < _count; i++) {
+            if (++slot >= _size) slot = 0;
+            if (_store[slot] < low) low = _store[slot];
+            if (_store[slot] > high) high = _store[slot];
+        }
+    }
+    return Summary::fromMoments(_count, _offset + mean, m2 > 0 ? m2 : 0, xyM2, (float)low, (float)high);
 }
 
 template <class T> void Average<T>::clear() {
     _count = 0;
     _sum = 0;
+    _compensation = 0;
+    _clearMoments();
     _position = 0;
+    _root = _NIL;
+}
+
+// Write the buffer contents and position
+template <class T> void Average<T>::saveState(StateWriter &out) const {
+    out.write(_size);
+    out.write(_count);
+    out.write(_position);
+    out.write((T)(_sum + _compensation));
+    out.write(_store, sizeof(T) * _size);
+}
+
+// Read the buffer contents and position: fails if the buffer size differs
+template <class T> bool Average<T>::loadState(StateReader &in) {
+    uint32_t size, count, position;
+    if (!in.read(size) || !in.read(count) || !in.read(position) ||
+        size != _size || count > _size || position >= _size ||
+        in.getAvailable() < sizeof(T) * (_size + 1)) {
+        return false;
+    }
+    _count = count;
+    _position = position;
+    in.read(_sum);
+    _compensation = 0;
+    in.read(_store, sizeof(T) * _size);
+    _clearMoments();                                          // rebuilt from the window, oldest first
+    uint32_t slot = (_position + _size - _count) % _size;
+    for (uint32_t i = 0; i < _count; i++) {
+        if (i == 0) _offset = _store[slot];
+        double value = _store[slot] - _offset;
+        compensatedAdd(_shifted, _shiftedCompensation, value);
+        compensatedAdd(_squares, _squaresCompensation, value * value);
+        compensatedAdd(_weighted, _weightedCompensation, i * value);
+        if (++slot >= _size) slot = 0;
+    }
+    _rebuildTree();
+    return true;
 }
 
 template <class T> Average<T> &Average<T>::operator=(Average<T> &a) {
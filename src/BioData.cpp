@@ -0,0 +1,129 @@
+/*
+ * BioData.cpp
+ *
+ * This class processes heart, skin conductance and respiration sensors
+ * together into synchronized feature frames.
+ *
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee
+ *
+ * Contributing authors:
+ * (c) 2018 Erin Gee
+ * (c) 2017 Thomas Ouellet Fredericks
+ * (c) 2018 Sofian Audry
+ * (c) 2017 Martin Peach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "BioData.h"
+
+#include <string.h>
+
+//=============================================CONSTRUCTORS=============================================//
+BioData::BioData(unsigned long heartRate, unsigned long skinConductanceRate, unsigned long respirationRate) :
+  heart(heartRate),
+  skinConductance(skinConductanceRate),
+  respiration(respirationRate),
+  sequence(0),
+  pendingFlags(0),
+  pendingBeats(0),
+  lastInterval(0),
+  eventHandler(NULL),
+  eventContext(NULL)
+{
+  heart.setEventHandler(onEvent, this);
+  skinConductance.setEventHandler(onEvent, this);
+  respiration.setEventHandler(onEvent, this);
+}
+
+//=================================================SET=============================================//
+void BioData::setEventHandler(BioEventHandler handler, void* context) {
+  eventHandler = handler;
+  eventContext = context;
+}
+
+void BioData::update(float heartSignal, float skinConductanceSignal, float respirationSignal) {
+  heart.update(heartSignal);
+  skinConductance.update(skinConductanceSignal);
+  respiration.update(respirationSignal);
+}
+
+void BioData::onEvent(const BioEvent& event, void* bioData) {
+  BioData* bio = static_cast<BioData*>(bioData);
+  switch (event.type) {
+    case EVENT_BEAT:
+      bio->pendingFlags |= FRAME_BEAT;
+      if (bio->pendingBeats < 0xFF) bio->pendingBeats++;
+      bio->lastInterval = event.value;
+      break;
+    case EVENT_BREATH_AMPLITUDE:
+      bio->pendingFlags |= FRAME_BREATH;
+      break;
+    case EVENT_SCR:
+      bio->pendingFlags |= FRAME_SCR;
+      break;
+    default:
+      break;
+  }
+
+  if (bio->eventHandler)
+    bio->eventHandler(event, bio->eventContext);
+}
+
+//=================================================GET=============================================//
+void BioData::getFrame(FeatureFrame& frame) {
+  getFrame(frame, micros());
+}
+
+void BioData::getFrame(FeatureFrame& frame, unsigned long timestampMicros) {
+  frame.sequence        = sequence++;
+  frame.timestampMicros = timestampMicros;
+  frame.version         = FEATURE_FRAME_VERSION;
+  frame.flags           = pendingFlags | (respiration.isExhaling() ? FRAME_EXHALING : 0);
+  frame.beats           = pendingBeats;
+  frame.reserved        = 0;
+
+  frame.heartNormalized      = heart.getNormalized();
+  frame.bpm                  = heart.getBPM();
+  frame.lastInterval         = lastInterval;
+  frame.heartAmplitudeChange = heart.amplitudeChange();
+  frame.bpmChange            = heart.bpmChange();
+
+  frame.scr = skinConductance.getSCR();
+  frame.scl = skinConductance.getSCL();
+
+  frame.respirationScaled          = respiration.getScaled();
+  frame.breathAmplitude            = respiration.getRawAmplitude();
+  frame.breathAmplitudeLevel       = respiration.getAmplitudeLevel();
+  frame.breathAmplitudeChange      = respiration.getAmplitudeChange();
+  frame.breathAmplitudeVariability = respiration.getAmplitudeVariability();
+  frame.rpm                        = respiration.getRpm();
+  frame.rpmLevel                   = respiration.getRpmLevel();
+  frame.rpmChange                  = respiration.getRpmChange();
+  frame.rpmVariability             = respiration.getRpmVariability();
+
+  pendingFlags = 0;
+  pendingBeats = 0;
+}
+
+size_t BioData::writeFrame(uint8_t* buffer, size_t size, unsigned long timestampMicros) {
+  if (size < sizeof(FeatureFrame))
+    return 0;
+
+  // The buffer may not be aligned for the frame: fill a local copy.
+  FeatureFrame frame;
+  getFrame(frame, timestampMicros);
+  memcpy(buffer, &frame, sizeof(FeatureFrame));
+  return sizeof(FeatureFrame);
+}
@@ -1,8 +1,8 @@
 /*
- * Heart.h
+ * BioData.h
  *
- * This class defines an object that can be used to gather information about
- * pulse as gathered through a photoplethysmograph such as the Pulse Sensor.
+ * Main header of the library: includes all sensors and defines an object
+ * that processes them together into synchronized feature frames.
  *
  * This file is part of the BioData project
  * (c) 2018 Erin Gee
@@ -29,8 +29,76 @@
 #ifndef BIO_DATA_H_
 #define BIO_DATA_H_
 
+#include "Events.h"
+#include "FeatureFrame.h"
 #include "Heart.h"
 #include "SkinConductance.h"
 #include "Respiration.h"
 
+/**
+ * Heart, skin conductance and respiration sensors processed together, with
+ * their features gathered into one FeatureFrame per output tick.
+ *
+ *   BioData bio;
+ *   FeatureFrame frame;
+ *   ...
+ *   bio.update(analogRead(A1), analogRead(A6), analogRead(A0));
+ *   if (frameMetro) {
+ *     bio.getFrame(frame);
+ *     Serial.write((const uint8_t*)&frame, sizeof(frame));
+ *   }
+ */
+class BioData {
+public:
+  /// Constructor with the sample rates of the sensors.
+  BioData(unsigned long heartRate=200, unsigned long skinConductanceRate=50, unsigned long respirationRate=50);
+  virtual ~BioData() {}
+
+  // The sensors send their events to this object: a copy would leave them
+  // calling back into the original.
+  BioData(const BioData&) = delete;
+  BioData& operator=(const BioData&) = delete;
+
+  Heart heart;
+  SkinConductance skinConductance;
+  Respiration respiration;
+
+  /// Updates all sensors (each one samples at its own rate).
+  void update(float heartSignal, float skinConductanceSignal, float respirationSignal);
+
+  /**
+   * Receives the events of all sensors (see Events.h). Use this rather than
+   * the sensors' own setEventHandler(), which BioData uses to flag beats,
+   * breaths and responses in frames.
+   */
+  void setEventHandler(BioEventHandler handler, void* context=NULL);
+
+  /// Fills frame with current features, stamped with the current time.
+  void getFrame(FeatureFrame& frame);
+
+  /**
+   * Fills frame with current features, stamped with timestampMicros. Beats,
+   * breaths and responses are counted since the previous frame.
+   */
+  void getFrame(FeatureFrame& frame, unsigned long timestampMicros);
+
+  /**
+   * Writes a frame into buffer. Returns the number of bytes written
+   * (sizeof(FeatureFrame)), or 0 if buffer is too small.
+   */
+  size_t writeFrame(uint8_t* buffer, size_t size, unsigned long timestampMicros);
+
+private:
+  // Latches sensor events until the next frame and forwards them.
+  static void onEvent(const BioEvent& event, void* bioData);
+
+  uint32_t sequence;
+  uint8_t pendingFlags;
+  uint8_t pendingBeats;
+  float lastInterval;
+
+  BioEventHandler eventHandler;
+  void* eventContext;
+};
+
 #endif
@@ -0,0 +1,322 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Second-order IIR filter sections (biquads) and cascades thereof.
+ *
+ * Coefficients follow the RBJ audio EQ cookbook (bilinear transform with
+ * frequency pre-warping) and can be designed at compile time, eg.
+ *
+ *   // 0.5-8 Hz Butterworth band-pass for PPG sampled at 200 Hz.
+ *   constexpr BiquadDesign<2> PPG_BAND = BiquadDesign<2>::butterworthBandpass(200, 0.5, 8);
+ *   BiquadCascade<2> ppgFilter(PPG_BAND);
+ *
+ * The state is kept in transposed direct form II, which has good numerical
+ * behavior in single precision.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BIQUAD_H_
+#define BIQUAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ConstMath.h"
+#include "State.h"
+
+/// Coefficients of a biquad section, normalized so that a0 = 1.
+struct BiquadCoefficients {
+  float b0, b1, b2;
+  float a1, a2;
+
+  /// Pass-through section.
+  static constexpr BiquadCoefficients identity() {
+    return BiquadCoefficients{ 1, 0, 0, 0, 0 };
+  }
+
+  /// Second-order low-pass at cutoff frequency fc (Hz) for sample rate fs (Hz).
+  static constexpr BiquadCoefficients lowpass(double fs, double fc, double q = 0.70710678118654752) {
+    return normalize(omegaCos(fs, fc), omegaAlpha(fs, fc, q), (1 - omegaCos(fs, fc)) / 2, 1 - omegaCos(fs, fc), (1 - omegaCos(fs, fc)) / 2);
+  }
+
+  /// Second-order high-pass at cutoff frequency fc (Hz) for sample rate fs (Hz).
+  static constexpr BiquadCoefficients highpass(double fs, double fc, double q = 0.70710678118654752) {
+    return normalize(omegaCos(fs, fc), omegaAlpha(fs, fc, q), (1 + omegaCos(fs, fc)) / 2, -(1 + omegaCos(fs, fc)), (1 + omegaCos(fs, fc)) / 2);
+  }
+
+  /// Second-order band-pass centered on fc (Hz) with 0 dB peak gain.
+  static constexpr BiquadCoefficients bandpass(double fs, double fc, double q) {
+    return normalize(omegaCos(fs, fc), omegaAlpha(fs, fc, q), omegaAlpha(fs, fc, q), 0, -omegaAlpha(fs, fc, q));
+  }
+
+  /// Quality factor of section k (0-based) of a Butterworth filter of given (even) order.
+  static constexpr double butterworthQ(uint8_t order, uint8_t k) {
+    return 1 / (2 * ConstMath::sin((2 * k + 1) * ConstMath::pi / (2 * order)));
+  }
+
+private:
+  static constexpr double omegaCos(double fs, double fc) {
+    return ConstMath::cos(2 * ConstMath::pi * fc / fs);
+  }
+
+  static constexpr double omegaAlpha(double fs, double fc, double q) {
+    return ConstMath::sin(2 * ConstMath::pi * fc / fs) / (2 * q);
+  }
+
+  static constexpr BiquadCoefficients normalize(double cosw, double alpha, double b0, double b1, double b2) {
+    return BiquadCoefficients{ float(b0 / (1 + alpha)), float(b1 / (1 + alpha)), float(b2 / (1 + alpha)),
+                               float(-2 * cosw / (1 + alpha)), float((1 - alpha) / (1 + alpha)) };
+  }
+};
+
+/// A fixed number of biquad sections meant to be applied in series.
+template <uint8_t N_SECTIONS>
+struct BiquadDesign {
+  BiquadCoefficients section[N_SECTIONS];
+
+  /// Butterworth low-pass of order 2*N_SECTIONS.
+  static constexpr BiquadDesign butterworthLowpass(double fs, double fc) {
+    return lowpassSections(fs, fc, typename ConstIndices<N_SECTIONS>::type());
+  }
+
+  /// Butterworth high-pass of order 2*N_SECTIONS.
+  static constexpr BiquadDesign butterworthHighpass(double fs, double fc) {
+    return highpassSections(fs, fc, typename ConstIndices<N_SECTIONS>::type());
+  }
+
+  /// Band-pass made of a Butterworth high-pass at low (Hz) followed by a
+  /// Butterworth low-pass at high (Hz), each of order N_SECTIONS (must be even).
+  static constexpr BiquadDesign butterworthBandpass(double fs, double low, double high) {
+    static_assert(N_SECTIONS % 2 == 0, "Band-pass needs an even number of sections.");
+    return bandpassSections(fs, low, high, typename ConstIndices<N_SECTIONS>::type());
+  }
+
+private:
+  // The sections are expanded from an index pack so that the designs are
+  // constant expressions in C++11 (see ConstMath.h).
+  template <size_t... K>
+  static constexpr BiquadDesign lowpassSections(double fs, double fc, ConstIndexList<K...>) {
+    return BiquadDesign{ { BiquadCoefficients::lowpass(fs, fc, BiquadCoefficients::butterworthQ(2 * N_SECTIONS, K))... } };
+  }
+
+  template <size_t... K>
+  static constexpr BiquadDesign highpassSections(double fs, double fc, ConstIndexList<K...>) {
+    return BiquadDesign{ { BiquadCoefficients::highpass(fs, fc, BiquadCoefficients::butterworthQ(2 * N_SECTIONS, K))... } };
+  }
+
+  template <size_t... K>
+  static constexpr BiquadDesign bandpassSections(double fs, double low, double high, ConstIndexList<K...>) {
+    return BiquadDesign{ { bandpassSection(fs, low, high, K)... } };
+  }
+
+  // High-pass sections first, then low-pass sections.
+  static constexpr BiquadCoefficients bandpassSection(double fs, double low, double high, size_t k) {
+    return k < N_SECTIONS / 2 ?
+      BiquadCoefficients::highpass(fs, low,  BiquadCoefficients::butterworthQ(N_SECTIONS, k)) :
+      BiquadCoefficients::lowpass (fs, high, BiquadCoefficients::butterworthQ(N_SECTIONS, k - N_SECTIONS / 2));
+  }
+};
+
+/// Single biquad section.
+class Biquad {
+  BiquadCoefficients c;
+
+  // Transposed direct form II state.
+  float z1;
+  float z2;
+
+public:
+  /// Constructor.
+  Biquad(const BiquadCoefficients& coefficients = BiquadCoefficients::identity()) : c(coefficients) {
+    reset();
+  }
+
+  /// Resets filter.
+  void reset() {
+    z1 = z2 = 0;
+  }
+
+  /// Changes coefficients (keeps the state).
+  void setCoefficients(const BiquadCoefficients& coefficients) {
+    c = coefficients;
+  }
+
+  /// Filters sample and returns filtered value.
+  float filter(float input) {
+    float output = c.b0 * input + z1;
+    z1 = c.b1 * input - c.a1 * output + z2;
+    z2 = c.b2 * input - c.a2 * output;
+    return output;
+  }
+
+  /// Filters a block of samples in place.
+  void filterBlock(float* data, size_t n) {
+    // Work on local copies so the compiler can keep the state in registers.
+    float s1 = z1, s2 = z2;
+    const float b0 = c.b0, b1 = c.b1, b2 = c.b2, a1 = c.a1, a2 = c.a2;
+    for (size_t i = 0; i < n; i++) {
+      float input  = data[i];
+      float output = b0 * input + s1;
+      s1 = b1 * input - a1 * output + s2;
+      s2 = b2 * input - a2 * output;
+      data[i] = output;
+    }
+    z1 = s1;
+    z2 = s2;
+  }
+
+  /// Writes filter state.
+  void saveState(StateWriter& out) const {
+    out.write(z1);
+    out.write(z2);
+  }
+
+  /// Reads filter state. Returns false if data is missing.
+  bool loadState(StateReader& in) {
+    float state[2];
+    if (!in.read(state))
+      return false;
+    z1 = state[0];
+    z2 = state[1];
+    return true;
+  }
+};
+
+/// Biquad sections applied in series on a single channel.
+template <uint8_t N_SECTIONS>
+class BiquadCascade {
+  Biquad sections[N_SECTIONS];
+
+public:
+  /// Constructor (pass-through until coefficients are set).
+  BiquadCascade() {}
+
+  /// Constructor.
+  BiquadCascade(const BiquadDesign<N_SECTIONS>& design) {
+    setDesign(design);
+  }
+
+  /// Resets filter.
+  void reset() {
+    for (uint8_t k = 0; k < N_SECTIONS; k++)
+      sections[k].reset();
+  }
+
+  /// Changes coefficients of all sections (keeps the state).
+  void setDesign(const BiquadDesign<N_SECTIONS>& design) {
+    for (uint8_t k = 0; k < N_SECTIONS; k++)
+      sections[k].setCoefficients(design.section[k]);
+  }
+
+  /// Filters sample and returns filtered value.
+  float filter(float input) {
+    for (uint8_t k = 0; k < N_SECTIONS; k++)
+      input = sections[k].filter(input);
+    return input;
+  }
+
+  /// Filters a block of samples in place, one section at a time.
+  void filterBlock(float* data, size_t n) {
+    for (uint8_t k = 0; k < N_SECTIONS; k++)
+      sections[k].filterBlock(data, n);
+  }
+
+  /// Writes filter state.
+  void saveState(StateWriter& out) const {
+    for (uint8_t k = 0; k < N_SECTIONS; k++)
+      sections[k].saveState(out);
+  }
+
+  /// Reads filter state. Returns false if data is missing.
+  bool loadState(StateReader& in) {
+    if (in.getAvailable() < N_SECTIONS * 2 * sizeof(float))
+      return false;
+    for (uint8_t k = 0; k < N_SECTIONS; k++)
+      sections[k].loadState(in);
+    return true;
+  }
+};
+
+/**
+ * Same biquad cascade applied to N_CHANNELS independent channels. State is
+ * stored channel-minor so that the inner loop over channels has no
+ * dependencies and can be vectorized by the compiler.
+ */
+template <uint8_t N_SECTIONS, uint8_t N_CHANNELS>
+class BiquadBank {
+  BiquadCoefficients c[N_SECTIONS];
+  float z1[N_SECTIONS][N_CHANNELS];
+  float z2[N_SECTIONS][N_CHANNELS];
+
+public:
+  /// Constructor.
+  BiquadBank(const BiquadDesign<N_SECTIONS>& design) {
+    setDesign(design);
+    reset();
+  }
+
+  /// Resets all channels.
+  void reset() {
+    for (uint8_t k = 0; k < N_SECTIONS; k++)
+      for (uint8_t ch = 0; ch < N_CHANNELS; ch++)
+        z1[k][ch] = z2[k][ch] = 0;
+  }
+
+  /// Changes coefficients (keeps the state).
+  void setDesign(const BiquadDesign<N_SECTIONS>& design) {
+    for (uint8_t k = 0; k < N_SECTIONS; k++)
+      c[k] = design.section[k];
+  }
+
+  /// Filters one frame (one sample per channel) in place.
+  void filter(float* frame) {
+    for (uint8_t k = 0; k < N_SECTIONS; k++) {
+      const BiquadCoefficients s = c[k];
+      float* s1 = z1[k];
+      float* s2 = z2[k];
+      for (uint8_t ch = 0; ch < N_CHANNELS; ch++) {
+        float input  = frame[ch];
+        float output = s.b0 * input + s1[ch];
+        s1[ch] = s.b1 * input - s.a1 * output + s2[ch];
+        s2[ch] = s.b2 * input - s.a2 * output;
+        frame[ch] = output;
+      }
+    }
+  }
+
+  /// Filters nFrames interleaved frames (N_CHANNELS samples each) in place.
+  void filterBlock(float* frames, size_t nFrames) {
+    for (size_t i = 0; i < nFrames; i++, frames += N_CHANNELS)
+      filter(frames);
+  }
+
+  /// Writes state of all channels.
+  void saveState(StateWriter& out) const {
+    out.write(z1);
+    out.write(z2);
+  }
+
+  /// Reads state of all channels. Returns false if data is missing.
+  bool loadState(StateReader& in) {
+    if (in.getAvailable() < sizeof(z1) + sizeof(z2))
+      return false;
+    in.read(z1);
+    in.read(z2);
+    return true;
+  }
+};
+
+#endif
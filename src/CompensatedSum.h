@@ -0,0 +1,46 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Neumaier compensated summation, for running sums that are updated forever
+ * (adding new values, subtracting old ones) and must not drift away from the
+ * values they stand for:
+ *
+ *   double sum = 0, compensation = 0;
+ *   compensatedAdd(sum, compensation, x);
+ *   ...
+ *   double total = sum + compensation;
+ *
+ * The rounding error of each addition is kept in compensation. Exact (and
+ * compensation stays 0) for integer types. Do not compile with -ffast-math,
+ * which removes the compensation.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPENSATED_SUM_H_
+#define COMPENSATED_SUM_H_
+
+/// Adds value to sum, keeping the rounding error in compensation.
+template <class T>
+inline void compensatedAdd(T& sum, T& compensation, T value) {
+  T total = sum + value;
+  if ((sum < 0 ? -sum : sum) >= (value < 0 ? -value : value))
+    compensation += (sum - total) + value;
+  else
+    compensation += (value - total) + sum;
+  sum = total;
+}
+
+#endif
@@ -0,0 +1,88 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Math functions that can be evaluated at compile time, used to design
+ * filter coefficients as constant expressions. They also work at runtime
+ * but are slower than their <math.h> counterparts.
+ *
+ * Each function is a single return statement so that it is a constant
+ * expression in C++11, which is what the Arduino cores compile with.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONST_MATH_H_
+#define CONST_MATH_H_
+
+#include <stddef.h>
+
+struct ConstMath {
+
+  static constexpr double pi = 3.14159265358979323846;
+
+  /// Sine of x (radians).
+  static constexpr double sin(double x) {
+    return sinReduced(reduce(x));
+  }
+
+  /// Cosine of x (radians).
+  static constexpr double cos(double x) {
+    return sin(x + pi / 2);
+  }
+
+  /// Tangent of x (radians).
+  static constexpr double tan(double x) {
+    return sin(x) / cos(x);
+  }
+
+private:
+  // Reduces x to [-pi, pi].
+  static constexpr double reduce(double x) {
+    return x - nearest(x / (2 * pi)) * 2 * pi;
+  }
+
+  static constexpr long nearest(double turns) {
+    return long(turns < 0 ? turns - 0.5 : turns + 0.5);
+  }
+
+  static constexpr double sinReduced(double x) {
+    return sinSeries(x, x, x, 1);
+  }
+
+  // Taylor series from term n: converges to double precision in about 12
+  // terms on [-pi, pi].
+  static constexpr double sinSeries(double x, double term, double sum, int n) {
+    return n < 14 ? sinTerm(x, term * (-x * x / ((2 * n) * (2 * n + 1))), sum, n) : sum;
+  }
+
+  static constexpr double sinTerm(double x, double term, double sum, int n) {
+    return sinSeries(x, term, sum + term, n + 1);
+  }
+};
+
+/// Indices 0..N-1 as a parameter pack, to fill arrays in constant expressions:
+/// a function taking a ConstIndexList<I...> can expand f(I)... in an initializer.
+template <size_t... I>
+struct ConstIndexList {};
+
+template <size_t N, size_t... I>
+struct ConstIndices : ConstIndices<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct ConstIndices<0, I...> {
+  typedef ConstIndexList<I...> type;
+};
+
+#endif
@@ -0,0 +1,228 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Anti-aliased integer-ratio decimation, used to bring a high-rate ADC
+ * stream (eg. 1 kHz DMA blocks) down to the rate of a sensor (eg. 200 Hz for
+ * Heart, 50 Hz for SkinConductance) without throwing samples away.
+ *
+ *   // 1 kHz -> 200 Hz.
+ *   Decimator<5, 31> decimator;
+ *   ...
+ *   size_t nOut = decimator.process(adcBlock, nIn, out);
+ *   for (size_t i=0; i<nOut; i++) heart.sample(out[i]);
+ *
+ * Large ratios are best split into stages, eg. 1 kHz -> 50 Hz as a
+ * Decimator<5, 31> followed by a Decimator<4, 27>.
+ *
+ * The default low-pass protects the band below 0.14 of the output rate
+ * (28 Hz at 200 Hz) by at least 74 dB, but the top of the output band is
+ * not clean: content just above the output Nyquist is only attenuated by
+ * about 20 dB and aliases there (see FirDesign::decimation()). Use more
+ * taps or a custom FirDesign if that band matters.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECIMATOR_H_
+#define DECIMATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ConstMath.h"
+#include "State.h"
+
+/// Linear-phase FIR low-pass coefficients (Blackman-windowed sinc).
+template <uint8_t N_TAPS>
+struct FirDesign {
+  static_assert(N_TAPS % 2 == 1, "Use an odd number of taps for a symmetric filter.");
+
+  float taps[N_TAPS];
+
+  /// Low-pass with cutoff expressed as a fraction of the input sample rate (in ]0, 0.5[).
+  static constexpr FirDesign lowpass(double cutoff) {
+    // Unity gain at DC.
+    return normalized(cutoff, tapSum(cutoff, 0, 0), typename ConstIndices<N_TAPS>::type());
+  }
+
+  /**
+   * Anti-aliasing low-pass for decimation by factor, with cutoff at 0.3 of
+   * the output rate over factor (0.3 / factor of the input rate). With the
+   * lengths suggested above (eg. Decimator<5, 31>, Decimator<4, 27>), the
+   * passband is flat within 1 dB up to 0.14 of the output rate (28 Hz at
+   * 200 Hz), and everything that would alias into it is attenuated by at
+   * least 74 dB. The stopband does not start at the output Nyquist: it is
+   * only attenuated by about 20 dB there, and what aliases from the
+   * transition band lands between the passband and the output Nyquist.
+   */
+  static constexpr FirDesign decimation(uint8_t factor) {
+    return lowpass(0.3 / factor);
+  }
+
+  /**
+   * Half-band low-pass (cutoff at a quarter of the input rate) for decimation
+   * by two. Every other coefficient is zero when N_TAPS is of the form 4k+3.
+   */
+  static constexpr FirDesign halfband() {
+    return lowpass(0.25);
+  }
+
+private:
+  // Written as single return statements so that the designs are constant
+  // expressions in C++11 (see ConstMath.h).
+  template <size_t... I>
+  static constexpr FirDesign normalized(double cutoff, double sum, ConstIndexList<I...>) {
+    return FirDesign{ { float(tap(cutoff, I) / sum)... } };
+  }
+
+  static constexpr double tapSum(double cutoff, int i, double sum) {
+    return i < N_TAPS ? tapSum(cutoff, i + 1, sum + tap(cutoff, i)) : sum;
+  }
+
+  // Blackman-windowed sinc.
+  static constexpr double tap(double cutoff, int i) {
+    return sinc(cutoff, i - (N_TAPS - 1) / 2) * window(2 * ConstMath::pi * i / (N_TAPS - 1));
+  }
+
+  static constexpr double sinc(double cutoff, double x) {
+    return (x == 0) ? 2 * cutoff : ConstMath::sin(2 * ConstMath::pi * cutoff * x) / (ConstMath::pi * x);
+  }
+
+  static constexpr double window(double phase) {
+    return 0.42 - 0.5 * ConstMath::cos(phase) + 0.08 * ConstMath::cos(2 * phase);
+  }
+};
+
+/**
+ * Decimates a signal by an integer FACTOR through an N_TAPS FIR low-pass.
+ * Only the retained output samples are computed (which is the arithmetic of
+ * a polyphase decimator): the cost is N_TAPS multiply-adds per output, ie.
+ * N_TAPS/FACTOR per input sample.
+ */
+template <uint8_t FACTOR, uint8_t N_TAPS>
+class Decimator {
+  // Default coefficients, designed at compile time.
+  static constexpr FirDesign<N_TAPS> defaultDesign = FirDesign<N_TAPS>::decimation(FACTOR);
+
+  FirDesign<N_TAPS> design;
+
+  // Input history stored twice so that the last N_TAPS samples are always
+  // contiguous, starting at history[position + 1].
+  float history[2 * N_TAPS];
+  uint8_t position;
+
+  // Inputs received since last output.
+  uint8_t phase;
+
+  // Last output value.
+  float value;
+
+public:
+  /// Constructor. Uses FirDesign<N_TAPS>::decimation(FACTOR) by default.
+  Decimator() : design(defaultDesign) {
+    reset();
+  }
+
+  /// Constructor with custom coefficients (must be symmetric).
+  Decimator(const FirDesign<N_TAPS>& design_) : design(design_) {
+    reset();
+  }
+
+  /// Resets filter.
+  void reset() {
+    for (int i = 0; i < 2 * N_TAPS; i++)
+      history[i] = 0;
+    position = 0;
+    phase = 0;
+    value = 0;
+  }
+
+  /// Decimation factor.
+  static constexpr uint8_t factor() { return FACTOR; }
+
+  /**
+   * Pushes one input sample. Returns true when a new output is available
+   * (once every FACTOR inputs), which can be read with get().
+   */
+  bool push(float input) {
+    position = (position + 1) % N_TAPS;
+    history[position] = history[position + N_TAPS] = input;
+
+    if (++phase < FACTOR)
+      return false;
+
+    phase = 0;
+    value = compute();
+    return true;
+  }
+
+  /// Returns last output value.
+  float get() const {
+    return value;
+  }
+
+  /**
+   * Decimates a block of nInput samples. Writes the outputs to output (which
+   * must have room for nInput / FACTOR + 1 values) and returns their number.
+   */
+  size_t process(const float* input, size_t nInput, float* output) {
+    size_t nOutput = 0;
+    for (size_t i = 0; i < nInput; i++) {
+      if (push(input[i]))
+        output[nOutput++] = value;
+    }
+    return nOutput;
+  }
+
+  /// Writes filter state.
+  void saveState(StateWriter& out) const {
+    out.write(history, N_TAPS * sizeof(float)); // the second copy is rebuilt on load
+    out.write(position);
+    out.write(phase);
+    out.write(value);
+  }
+
+  /// Reads filter state. Returns false if data is missing.
+  bool loadState(StateReader& in) {
+    float history_[N_TAPS];
+    uint8_t position_, phase_;
+    float value_;
+    if (!in.read(history_) || !in.read(position_) || !in.read(phase_) || !in.read(value_) ||
+        position_ >= N_TAPS || phase_ >= FACTOR)
+      return false;
+    for (int i = 0; i < N_TAPS; i++)
+      history[i] = history[i + N_TAPS] = history_[i];
+    position = position_;
+    phase = phase_;
+    value = value_;
+    return true;
+  }
+
+private:
+  float compute() const {
+    // The filter is symmetric, so the taps can be applied oldest-first on
+    // the contiguous history.
+    const float* x = &history[position + 1];
+    float sum = 0;
+    for (int k = 0; k < N_TAPS; k++)
+      sum += design.taps[k] * x[k];
+    return sum;
+  }
+};
+
+template <uint8_t FACTOR, uint8_t N_TAPS>
+constexpr FirDesign<N_TAPS> Decimator<FACTOR, N_TAPS>::defaultDesign;
+
+#endif
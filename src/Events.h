@@ -0,0 +1,168 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Typed events emitted by the sensors (beats, exhales/inhales, breath
+ * amplitudes, skin conductance responses), delivered to a callback or to a
+ * bounded queue that can be drained in batches instead of polling getters
+ * on every loop.
+ *
+ *   EventQueue<16> events;
+ *   heart.setEventHandler(EventQueue<16>::handler, &events);
+ *   ...
+ *   BioEvent e;
+ *   while (events.pop(e))
+ *     if (e.type == EVENT_BEAT) Serial.println(e.value); // inter-beat interval (ms)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENTS_H_
+#define EVENTS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory barrier ordering the slots of EventQueue with its indices. A
+// compiler barrier is enough on single-core AVR, where the other side is an
+// interrupt; elsewhere a full fence also orders the stores between cores.
+#if defined(ARDUINO) && defined(__AVR__)
+#define BIODATA_MEMORY_BARRIER() __asm__ __volatile__("" ::: "memory")
+#elif defined(__GNUC__)
+#define BIODATA_MEMORY_BARRIER() __sync_synchronize()
+#else
+#include <atomic>
+#define BIODATA_MEMORY_BARRIER() std::atomic_thread_fence(std::memory_order_seq_cst)
+#endif
+
+/// Types of events.
+enum BioEventType {
+  EVENT_BEAT,             // Heart: beat detected, value = inter-beat interval (ms)
+  EVENT_EXHALE,           // Respiration: exhale starts, value = scaled signal
+  EVENT_INHALE,           // Respiration: inhale starts, value = scaled signal
+  EVENT_BREATH_AMPLITUDE, // Respiration: new breath amplitude, value = amplitude (signal units)
+  EVENT_SCR               // SkinConductance: response onset, value = SCR
+};
+
+/// An event emitted by a sensor.
+struct BioEvent {
+  uint8_t type;                  // see BioEventType
+  unsigned long timestampMicros; // time of the sample that triggered the event
+  float value;                   // depends on type
+  const void* source;            // sensor that emitted the event
+};
+
+/// Event callback: receives the event and the context given at registration.
+typedef void (*BioEventHandler)(const BioEvent& event, void* context);
+
+/// Dispatches events of a sensor to its registered handler (if any).
+class EventEmitter {
+  BioEventHandler handler;
+  void* context;
+
+public:
+  EventEmitter() : handler(NULL), context(NULL) {}
+
+  /// Registers handler (NULL to unregister).
+  void setHandler(BioEventHandler handler_, void* context_=NULL) {
+    handler = handler_;
+    context = context_;
+  }
+
+  /// Returns true if a handler is registered.
+  bool enabled() const {
+    return handler != NULL;
+  }
+
+  /// Sends an event to the handler.
+  void emit(uint8_t type, unsigned long timestampMicros, float value, const void* source) {
+    if (handler) {
+      BioEvent event = { type, timestampMicros, value, source };
+      handler(event, context);
+    }
+  }
+};
+
+/**
+ * Bounded FIFO of events. When full, new events are dropped and counted.
+ * Safe with one producer and one consumer (eg. sensors updated in an
+ * interrupt and the queue drained in loop(), or two threads): each side
+ * only writes its own index, and barriers make an event visible before the
+ * index that publishes it, and free a slot only once it has been read.
+ */
+template <uint8_t CAPACITY>
+class EventQueue {
+  BioEvent events[CAPACITY + 1];
+  volatile uint8_t head; // next slot to read
+  volatile uint8_t tail; // next slot to write
+  unsigned long dropped;
+
+public:
+  EventQueue() : head(0), tail(0), dropped(0) {}
+
+  /// Handler to register with a sensor: context must point to the queue.
+  static void handler(const BioEvent& event, void* queue) {
+    static_cast<EventQueue*>(queue)->push(event);
+  }
+
+  /// Adds an event. Returns false if the queue is full.
+  bool push(const BioEvent& event) {
+    uint8_t next = (tail + 1) % (CAPACITY + 1);
+    if (next == head) {
+      dropped++;
+      return false;
+    }
+    BIODATA_MEMORY_BARRIER(); // slot is read by the consumer before head moved past it
+    events[tail] = event;
+    BIODATA_MEMORY_BARRIER(); // event is written before it is published
+    tail = next;
+    return true;
+  }
+
+  /// Removes oldest event into event. Returns false if the queue is empty.
+  bool pop(BioEvent& event) {
+    if (head == tail)
+      return false;
+    BIODATA_MEMORY_BARRIER(); // event is read after tail published it
+    event = events[head];
+    BIODATA_MEMORY_BARRIER(); // event is read before its slot is released
+    head = (head + 1) % (CAPACITY + 1);
+    return true;
+  }
+
+  /// Removes up to maxEvents events into out (oldest first) and returns their number.
+  size_t drain(BioEvent* out, size_t maxEvents) {
+    size_t n = 0;
+    while (n < maxEvents && pop(out[n]))
+      n++;
+    return n;
+  }
+
+  /// Returns number of events waiting.
+  uint8_t size() const {
+    return (tail + CAPACITY + 1 - head) % (CAPACITY + 1);
+  }
+
+  /// Returns true if no events are waiting.
+  bool empty() const {
+    return head == tail;
+  }
+
+  /// Returns number of events dropped because the queue was full.
+  unsigned long getDropped() const {
+    return dropped;
+  }
+};
+
+#endif
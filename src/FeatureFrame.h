@@ -0,0 +1,77 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Fixed-layout frame holding the features of all sensors at one output
+ * tick, as produced by BioData::getFrame(). Frames can be sent or logged
+ * as raw bytes and read back with the same struct on the receiving side.
+ *
+ * All fields are 4-byte aligned so the struct has no padding and the same
+ * layout on every supported compiler. Values are in the byte order of the
+ * producing machine (little-endian on all boards supported by BioData).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FEATURE_FRAME_H_
+#define FEATURE_FRAME_H_
+
+#include <stdint.h>
+
+/// Version of the FeatureFrame layout, stored in each frame.
+static const uint8_t FEATURE_FRAME_VERSION = 1;
+
+/// Bits of FeatureFrame::flags.
+enum FeatureFrameFlag {
+  FRAME_BEAT      = 0x01, // at least one beat since previous frame
+  FRAME_EXHALING  = 0x02, // exhaling at the time of the frame
+  FRAME_SCR       = 0x04, // skin conductance response onset since previous frame
+  FRAME_BREATH    = 0x08  // exhale peak (new breath amplitude) since previous frame
+};
+
+struct FeatureFrame {
+  // Header.
+  uint32_t sequence;        // frame number, increases by one at each frame
+  uint32_t timestampMicros; // time of the frame
+  uint8_t  version;         // FEATURE_FRAME_VERSION
+  uint8_t  flags;           // see FeatureFrameFlag
+  uint8_t  beats;           // number of beats since previous frame
+  uint8_t  reserved;
+
+  // Heart.
+  float heartNormalized;    // normalized signal [0, 1]
+  float bpm;                // beats per minute
+  float lastInterval;       // last inter-beat interval (ms)
+  float heartAmplitudeChange;
+  float bpmChange;
+
+  // Skin conductance.
+  float scr;                // skin conductance response [0, 1]
+  float scl;                // skin conductance level [0, 1]
+
+  // Respiration.
+  float respirationScaled;  // scaled signal [0, 1]
+  float breathAmplitude;    // raw breath amplitude (signal units)
+  float breathAmplitudeLevel;
+  float breathAmplitudeChange;
+  float breathAmplitudeVariability;
+  float rpm;                // respirations per minute
+  float rpmLevel;
+  float rpmChange;
+  float rpmVariability;
+};
+
+static_assert(sizeof(FeatureFrame) == 76, "FeatureFrame must have no padding");
+
+#endif
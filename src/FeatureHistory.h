@@ -0,0 +1,242 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Fixed-memory history of a feature (BPM, SCL, RPM...) at several time
+ * resolutions. Each level is a ring of aggregates (min, max, mean, last)
+ * covering ratio entries of the level below, or ratio samples for level 0.
+ * Pushing a sample costs O(1) amortized: levels are only updated when the
+ * level below completes an entry.
+ *
+ * Storage is provided by the caller, so nothing is allocated. For features
+ * computed at 10 Hz, the last 10 s at full rate, 10 min at 1 Hz and 24 h at
+ * 1/min:
+ *
+ *   HistoryAggregate seconds[100], minutes[600], day[1440];
+ *   FeatureHistory<3> bpmHistory;
+ *   bpmHistory.setLevel(0, seconds, 100, 1);  // 1 sample per entry
+ *   bpmHistory.setLevel(1, minutes, 600, 10); // 10 entries of level 0 per entry
+ *   bpmHistory.setLevel(2, day, 1440, 60);    // 60 entries of level 1 per entry
+ *   ...
+ *   bpmHistory.push(heart.getBPM());
+ *   ...
+ *   HistoryAggregate last[60];
+ *   uint32_t n = bpmHistory.copyLast(1, 60, last); // last minute, oldest first
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FEATURE_HISTORY_H_
+#define FEATURE_HISTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// Aggregate of the samples covered by one history entry.
+struct HistoryAggregate {
+  float minimum;
+  float maximum;
+  float sum;
+  float last;
+  uint32_t count; // number of samples
+
+  /// Returns mean of the samples.
+  float mean() const {
+    return count ? sum / count : 0;
+  }
+
+  /// Starts the aggregate with one sample.
+  void set(float value) {
+    minimum = maximum = sum = last = value;
+    count = 1;
+  }
+
+  /// Adds the samples of a later aggregate.
+  void merge(const HistoryAggregate& next) {
+    if (count == 0) {
+      *this = next;
+      return;
+    }
+    if (next.minimum < minimum) minimum = next.minimum;
+    if (next.maximum > maximum) maximum = next.maximum;
+    sum += next.sum;
+    last = next.last;
+    count += next.count;
+  }
+};
+
+template <uint8_t N_LEVELS>
+class FeatureHistory {
+  struct Level {
+    HistoryAggregate* buffer;
+    uint32_t capacity;
+    uint32_t ratio;       // entries of the level below (samples for level 0) per entry
+    uint32_t position;    // next entry written
+    uint32_t size;        // number of complete entries
+    HistoryAggregate current; // entry being filled
+    uint32_t filled;      // entries of the level below in current
+  };
+
+  Level levels[N_LEVELS];
+
+  // Number of levels set.
+  uint8_t nLevels;
+
+  // Total number of samples pushed.
+  uint32_t nSamples;
+
+public:
+  /// Constructor. Levels must be set with setLevel() before use.
+  FeatureHistory() : nLevels(0), nSamples(0) {
+    memset(levels, 0, sizeof(levels));
+  }
+
+  /**
+   * Sets storage and resolution of a level: buffer holds capacity entries,
+   * each aggregating ratio entries of the level below (or ratio samples for
+   * level 0). Levels must be set in order. Clears the history. Returns false
+   * if the arguments are invalid.
+   */
+  bool setLevel(uint8_t level, HistoryAggregate* buffer, uint32_t capacity, uint32_t ratio) {
+    if (level >= N_LEVELS || level > nLevels || !buffer || capacity == 0 || ratio == 0)
+      return false;
+    Level& l = levels[level];
+    l.buffer = buffer;
+    l.capacity = capacity;
+    l.ratio = ratio;
+    if (level == nLevels)
+      nLevels++;
+    clear();
+    return true;
+  }
+
+  /// Removes all entries.
+  void clear() {
+    for (uint8_t i = 0; i < nLevels; i++) {
+      levels[i].position = levels[i].size = levels[i].filled = 0;
+      levels[i].current.count = 0;
+    }
+    nSamples = 0;
+  }
+
+  /// Adds a sample.
+  void push(float value) {
+    if (nLevels == 0)
+      return;
+    nSamples++;
+
+    HistoryAggregate entry;
+    entry.set(value);
+    for (uint8_t i = 0; i < nLevels; i++) {
+      Level& l = levels[i];
+      l.current.merge(entry);
+      if (++l.filled < l.ratio)
+        return;
+
+      // Entry complete: store it and pass it to the next level.
+      l.buffer[l.position] = l.current;
+      if (++l.position >= l.capacity) l.position = 0;
+      if (l.size < l.capacity) l.size++;
+      entry = l.current;
+      l.current.count = 0;
+      l.filled = 0;
+    }
+  }
+
+  /// Returns number of levels set.
+  uint8_t getLevels() const {
+    return nLevels;
+  }
+
+  /// Returns number of complete entries in level.
+  uint32_t getSize(uint8_t level) const {
+    return level < nLevels ? levels[level].size : 0;
+  }
+
+  /// Returns maximum number of entries in level.
+  uint32_t getCapacity(uint8_t level) const {
+    return level < nLevels ? levels[level].capacity : 0;
+  }
+
+  /// Returns number of samples per entry of level.
+  uint32_t getSamplesPerEntry(uint8_t level) const {
+    uint32_t samples = 1;
+    for (uint8_t i = 0; i <= level && i < nLevels; i++)
+      samples *= levels[i].ratio;
+    return samples;
+  }
+
+  /// Returns total number of samples pushed.
+  uint32_t getSampleCount() const {
+    return nSamples;
+  }
+
+  /**
+   * Returns complete entry index of level, 0 being the oldest. index must be
+   * lower than getSize(level).
+   */
+  const HistoryAggregate& get(uint8_t level, uint32_t index) const {
+    const Level& l = levels[level];
+    uint32_t i = start(l) + index;
+    if (i >= l.capacity) i -= l.capacity;
+    return l.buffer[i];
+  }
+
+  /**
+   * Returns the entry of level being filled (count is 0 if empty), eg. to
+   * show the current minute before it is complete.
+   */
+  const HistoryAggregate& getCurrent(uint8_t level) const {
+    return levels[level].current;
+  }
+
+  /**
+   * Copies up to n complete entries of level starting at index (0 being the
+   * oldest) into out, oldest first. Returns number of entries copied.
+   */
+  uint32_t copy(uint8_t level, uint32_t index, uint32_t n, HistoryAggregate* out) const {
+    if (level >= nLevels)
+      return 0;
+    const Level& l = levels[level];
+    if (index >= l.size)
+      return 0;
+    if (n > l.size - index)
+      n = l.size - index;
+
+    // At most two contiguous runs in the ring.
+    uint32_t i = start(l) + index;
+    if (i >= l.capacity) i -= l.capacity;
+    uint32_t first = l.capacity - i;
+    if (first > n) first = n;
+    memcpy(out, l.buffer + i, first * sizeof(HistoryAggregate));
+    memcpy(out + first, l.buffer, (n - first) * sizeof(HistoryAggregate));
+    return n;
+  }
+
+  /// Copies the n most recent complete entries of level into out, oldest first.
+  uint32_t copyLast(uint8_t level, uint32_t n, HistoryAggregate* out) const {
+    uint32_t size = getSize(level);
+    if (n > size) n = size;
+    return copy(level, size - n, n, out);
+  }
+
+private:
+  // Index of the oldest entry.
+  static uint32_t start(const Level& l) {
+    return l.size < l.capacity ? 0 : l.position;
+  }
+};
+
+#endif
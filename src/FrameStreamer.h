@@ -0,0 +1,475 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Streams the feature frames of many subjects over UDP, packed into
+ * datagrams that fit the network MTU, either as raw binary frames or as
+ * OSC bundles with one message per subject frame. Host computers only
+ * (POSIX sockets).
+ *
+ *   FrameStreamer streamer;
+ *   streamer.open("192.168.1.10", 9000, STREAM_OSC);
+ *   streamer.setMaxLatency(5000); // send at least every 5 ms
+ *   ...
+ *   for (int s = 0; s < nSubjects; s++)
+ *     streamer.add(s, frames[s]);
+ *   streamer.update(); // sends pending frames that have waited long enough
+ *
+ * Each datagram carries a sequence number, so that FrameReceiver (or any
+ * other receiver) can count lost datagrams.
+ *
+ * Binary datagrams, all big-endian: a 12-byte header { magic "BDFS",
+ * version (uint8), mode (uint8), sequence (uint32), count (uint16) } followed
+ * by count records { subject (uint16), reserved (uint16), FeatureFrame } with
+ * the FeatureFrame fields in declaration order (76 bytes).
+ *
+ * OSC datagrams: a bundle holding /biodata/seq (int sequence) followed by
+ * one /biodata/frame message per subject frame with arguments
+ * subject, frame sequence, timestamp, flags, beats (int32) and the 16 float
+ * features in FeatureFrame order.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_STREAMER_H_
+#define FRAME_STREAMER_H_
+
+#if !defined(ARDUINO) && (defined(__unix__) || defined(__APPLE__))
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "FeatureFrame.h"
+
+/// Datagram formats.
+enum StreamMode {
+  STREAM_BINARY = 0,
+  STREAM_OSC = 1
+};
+
+/// Encoding of datagrams shared by FrameStreamer and FrameReceiver.
+struct FrameDatagram {
+  static const uint8_t VERSION = 2; // 1 was in the byte order of the sender
+
+  enum {
+    /// Largest UDP payload that fits a 1500-byte Ethernet MTU without fragmentation.
+    DEFAULT_MAX_SIZE = 1472,
+
+    /// Binary header and record sizes.
+    HEADER_SIZE = 12,
+    RECORD_SIZE = 4 + sizeof(FeatureFrame),
+
+    /// Number of float features, stored contiguously from FeatureFrame::heartNormalized.
+    N_FEATURES = 16,
+
+    /// OSC sizes: bundle header, sequence message and one frame message (with their size prefix).
+    OSC_BUNDLE_SIZE = 16,
+    OSC_SEQUENCE_SIZE = 4 + 16 + 4 + 4,
+    OSC_FRAME_SIZE = 4 + 16 + 24 + 5 * 4 + N_FEATURES * 4
+  };
+
+  static const float* features(const FeatureFrame& frame) { return &frame.heartNormalized; }
+  static float* features(FeatureFrame& frame) { return &frame.heartNormalized; }
+
+  // Big-endian encoding.
+  static void putShort(uint8_t* p, uint16_t v) {
+    p[0] = v >> 8; p[1] = v;
+  }
+  static uint16_t getShort(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+  }
+  static void putInt(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+  }
+  static uint32_t getInt(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+  }
+  static void putFloat(uint8_t* p, float f) {
+    uint32_t v;
+    memcpy(&v, &f, 4);
+    putInt(p, v);
+  }
+  static float getFloat(const uint8_t* p) {
+    uint32_t v = getInt(p);
+    float f;
+    memcpy(&f, &v, 4);
+    return f;
+  }
+
+  // Binary record: subject, reserved, then the frame fields in order.
+  static void putRecord(uint8_t* p, uint16_t subject, const FeatureFrame& frame) {
+    putShort(p, subject);
+    putShort(p + 2, 0);
+    putInt(p + 4, frame.sequence);
+    putInt(p + 8, frame.timestampMicros);
+    p[12] = frame.version;
+    p[13] = frame.flags;
+    p[14] = frame.beats;
+    p[15] = frame.reserved;
+    p += 16;
+    const float* values = features(frame);
+    for (int i = 0; i < N_FEATURES; i++, p += 4)
+      putFloat(p, values[i]);
+  }
+  static uint16_t getRecord(const uint8_t* p, FeatureFrame& frame) {
+    uint16_t subject = getShort(p);
+    frame.sequence = getInt(p + 4);
+    frame.timestampMicros = getInt(p + 8);
+    frame.version = p[12];
+    frame.flags = p[13];
+    frame.beats = p[14];
+    frame.reserved = p[15];
+    p += 16;
+    float* values = features(frame);
+    for (int i = 0; i < N_FEATURES; i++, p += 4)
+      values[i] = getFloat(p);
+    return subject;
+  }
+};
+
+static_assert(offsetof(FeatureFrame, rpmVariability) - offsetof(FeatureFrame, heartNormalized) ==
+              (FrameDatagram::N_FEATURES - 1) * sizeof(float), "features must be contiguous");
+
+/// Sends subject frames over UDP in batches.
+class FrameStreamer {
+  int sock;
+  sockaddr_in destination;
+  uint8_t mode;
+
+  uint8_t buffer[FrameDatagram::DEFAULT_MAX_SIZE];
+  size_t maxSize;
+  size_t size;
+  uint16_t count;
+
+  uint32_t sequence;
+  unsigned long maxLatency;
+  unsigned long batchStart;
+
+  unsigned long nSent;
+  unsigned long nErrors;
+
+public:
+  FrameStreamer() : sock(-1), mode(STREAM_BINARY), maxSize(FrameDatagram::DEFAULT_MAX_SIZE), size(0), count(0),
+                    sequence(0), maxLatency(0), batchStart(0), nSent(0), nErrors(0) {}
+  ~FrameStreamer() { close(); }
+
+  FrameStreamer(const FrameStreamer&) = delete;
+  FrameStreamer& operator=(const FrameStreamer&) = delete;
+
+  /// Opens a socket sending to host (IPv4 address) and port. Returns false on error.
+  bool open(const char* host, uint16_t port, uint8_t mode_=STREAM_BINARY) {
+    close();
+    memset(&destination, 0, sizeof(destination));
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &destination.sin_addr) != 1)
+      return false;
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+      return false;
+    mode = mode_;
+    size = count = 0;
+    return true;
+  }
+
+  /// Sends pending frames and closes the socket.
+  void close() {
+    if (sock >= 0) {
+      flush();
+      ::close(sock);
+    }
+    sock = -1;
+  }
+
+  /**
+   * Sets the longest time a frame may wait for its datagram to fill up
+   * before it is sent, checked by add() and update(). Default is 0: each
+   * add() sends a datagram.
+   */
+  void setMaxLatency(unsigned long micros) {
+    maxLatency = micros;
+  }
+
+  /// Sets maximum datagram size (at most FrameDatagram::DEFAULT_MAX_SIZE), eg. lower for tunnels.
+  void setMaxDatagramSize(size_t bytes) {
+    flush();
+    maxSize = bytes < (size_t)FrameDatagram::DEFAULT_MAX_SIZE ? bytes : (size_t)FrameDatagram::DEFAULT_MAX_SIZE;
+  }
+
+  /// Adds the frame of a subject to the current datagram. Returns false if a send failed.
+  bool add(uint16_t subject, const FeatureFrame& frame) {
+    bool ok = true;
+    if (size + recordSize() > maxSize)
+      ok = flush();
+    if (count == 0) {
+      begin();
+      batchStart = nowMicros();
+    }
+    if (size + recordSize() > maxSize) // datagram too small for a single frame
+      return false;
+
+    if (mode == STREAM_OSC)
+      putOscFrame(buffer + size, subject, frame);
+    else
+      FrameDatagram::putRecord(buffer + size, subject, frame);
+    size += recordSize();
+    count++;
+
+    return update() && ok;
+  }
+
+  /// Sends the current datagram if its oldest frame has waited long enough.
+  bool update() {
+    if (count > 0 && nowMicros() - batchStart >= maxLatency)
+      return flush();
+    return true;
+  }
+
+  /// Sends the current datagram now.
+  bool flush() {
+    if (count == 0 || sock < 0)
+      return true;
+
+    if (mode != STREAM_OSC)
+      FrameDatagram::putShort(buffer + 10, count);
+    ssize_t n = sendto(sock, buffer, size, 0, (const sockaddr*)&destination, sizeof(destination));
+    size = count = 0;
+    sequence++;
+    if (n < 0) {
+      nErrors++;
+      return false;
+    }
+    nSent++;
+    return true;
+  }
+
+  /// Returns number of datagrams sent.
+  unsigned long getSentCount() const { return nSent; }
+
+  /// Returns number of datagrams that could not be sent.
+  unsigned long getErrorCount() const { return nErrors; }
+
+  /// Returns how many subject frames fit in one datagram.
+  size_t getFramesPerDatagram() const {
+    return (maxSize - headerSize()) / recordSize();
+  }
+
+private:
+  static unsigned long nowMicros() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long)t.tv_sec * 1000000UL + t.tv_nsec / 1000;
+  }
+
+  size_t headerSize() const {
+    return mode == STREAM_OSC ? (size_t)FrameDatagram::OSC_BUNDLE_SIZE + FrameDatagram::OSC_SEQUENCE_SIZE : (size_t)FrameDatagram::HEADER_SIZE;
+  }
+
+  size_t recordSize() const {
+    return mode == STREAM_OSC ? (size_t)FrameDatagram::OSC_FRAME_SIZE : (size_t)FrameDatagram::RECORD_SIZE;
+  }
+
+  // Writes the datagram header.
+  void begin() {
+    if (mode == STREAM_OSC) {
+      memcpy(buffer, "#bundle\0", 8);
+      FrameDatagram::putInt(buffer + 8, 0);  // time tag: immediately
+      FrameDatagram::putInt(buffer + 12, 1);
+      uint8_t* p = buffer + FrameDatagram::OSC_BUNDLE_SIZE;
+      FrameDatagram::putInt(p, FrameDatagram::OSC_SEQUENCE_SIZE - 4);
+      memcpy(p + 4, "/biodata/seq\0\0\0\0", 16);
+      memcpy(p + 20, ",i\0\0", 4);
+      FrameDatagram::putInt(p + 24, sequence);
+    }
+    else {
+      memcpy(buffer, "BDFS", 4);
+      buffer[4] = FrameDatagram::VERSION;
+      buffer[5] = mode;
+      FrameDatagram::putInt(buffer + 6, sequence);
+      // Count is written by flush().
+    }
+    size = headerSize();
+  }
+
+  static void putOscFrame(uint8_t* p, uint16_t subject, const FeatureFrame& frame) {
+    FrameDatagram::putInt(p, FrameDatagram::OSC_FRAME_SIZE - 4);
+    p += 4;
+    memcpy(p, "/biodata/frame\0\0", 16);
+    p += 16;
+    memcpy(p, ",iiiiiffffffffffffffff\0\0", 24);
+    p += 24;
+    FrameDatagram::putInt(p, subject);
+    FrameDatagram::putInt(p + 4, frame.sequence);
+    FrameDatagram::putInt(p + 8, frame.timestampMicros);
+    FrameDatagram::putInt(p + 12, frame.flags);
+    FrameDatagram::putInt(p + 16, frame.beats);
+    p += 20;
+    const float* features = FrameDatagram::features(frame);
+    for (int i = 0; i < FrameDatagram::N_FEATURES; i++, p += 4)
+      FrameDatagram::putFloat(p, features[i]);
+  }
+};
+
+/// Receives datagrams sent by FrameStreamer and counts lost ones.
+class FrameReceiver {
+  int sock;
+  uint8_t buffer[65536];
+
+  bool started;
+  uint32_t expected;
+  unsigned long nReceived;
+  unsigned long nLost;
+  unsigned long nInvalid;
+
+public:
+  /// Called for each subject frame of a datagram.
+  typedef void (*Handler)(uint16_t subject, const FeatureFrame& frame, void* context);
+
+  FrameReceiver() : sock(-1), started(false), expected(0), nReceived(0), nLost(0), nInvalid(0) {}
+  ~FrameReceiver() { close(); }
+
+  FrameReceiver(const FrameReceiver&) = delete;
+  FrameReceiver& operator=(const FrameReceiver&) = delete;
+
+  /// Listens on port (all interfaces). Returns false on error.
+  bool open(uint16_t port) {
+    close();
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+      return false;
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(sock, (const sockaddr*)&address, sizeof(address)) < 0) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (sock >= 0)
+      ::close(sock);
+    sock = -1;
+  }
+
+  /**
+   * Waits up to timeoutMillis for a datagram (binary or OSC) and calls
+   * handler on each of its frames. Returns the number of frames, 0 on
+   * timeout and -1 on error or invalid datagram.
+   */
+  int receive(Handler handler, void* context, int timeoutMillis) {
+    if (sock < 0)
+      return -1;
+    pollfd p = { sock, POLLIN, 0 };
+    int ready = poll(&p, 1, timeoutMillis);
+    if (ready <= 0)
+      return ready;
+
+    ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+    if (n < 0)
+      return -1;
+
+    int nFrames = (n >= 8 && memcmp(buffer, "#bundle", 8) == 0) ? parseOsc(n, handler, context) : parseBinary(n, handler, context);
+    if (nFrames < 0)
+      nInvalid++;
+    return nFrames;
+  }
+
+  /// Returns number of valid datagrams received.
+  unsigned long getReceivedCount() const { return nReceived; }
+
+  /// Returns number of datagrams missing from the sequence.
+  unsigned long getLostCount() const { return nLost; }
+
+  /// Returns number of invalid datagrams.
+  unsigned long getInvalidCount() const { return nInvalid; }
+
+private:
+  void track(uint32_t sequence) {
+    if (started && (int32_t)(sequence - expected) > 0)
+      nLost += sequence - expected;
+    started = true;
+    expected = sequence + 1;
+    nReceived++;
+  }
+
+  int parseBinary(size_t n, Handler handler, void* context) {
+    if (n < FrameDatagram::HEADER_SIZE)
+      return -1;
+    uint32_t sequence = FrameDatagram::getInt(buffer + 6);
+    uint16_t count = FrameDatagram::getShort(buffer + 10);
+    if (memcmp(buffer, "BDFS", 4) != 0 || buffer[4] != FrameDatagram::VERSION ||
+        n != FrameDatagram::HEADER_SIZE + count * (size_t)FrameDatagram::RECORD_SIZE)
+      return -1;
+
+    track(sequence);
+    const uint8_t* p = buffer + FrameDatagram::HEADER_SIZE;
+    for (uint16_t i = 0; i < count; i++, p += FrameDatagram::RECORD_SIZE) {
+      FeatureFrame frame;
+      uint16_t subject = FrameDatagram::getRecord(p, frame);
+      if (handler)
+        handler(subject, frame, context);
+    }
+    return count;
+  }
+
+  int parseOsc(size_t n, Handler handler, void* context) {
+    size_t offset = FrameDatagram::OSC_BUNDLE_SIZE;
+    if (n < offset + FrameDatagram::OSC_SEQUENCE_SIZE ||
+        memcmp(buffer + offset + 4, "/biodata/seq", 13) != 0)
+      return -1;
+    track(FrameDatagram::getInt(buffer + offset + 24));
+    offset += FrameDatagram::OSC_SEQUENCE_SIZE;
+
+    int count = 0;
+    while (offset + FrameDatagram::OSC_FRAME_SIZE <= n) {
+      const uint8_t* p = buffer + offset;
+      if (FrameDatagram::getInt(p) != FrameDatagram::OSC_FRAME_SIZE - 4 || memcmp(p + 4, "/biodata/frame", 15) != 0)
+        return -1;
+      p += 4 + 16 + 24;
+      FeatureFrame frame;
+      memset(&frame, 0, sizeof(frame));
+      uint16_t subject = FrameDatagram::getInt(p);
+      frame.sequence = FrameDatagram::getInt(p + 4);
+      frame.timestampMicros = FrameDatagram::getInt(p + 8);
+      frame.flags = FrameDatagram::getInt(p + 12);
+      frame.beats = FrameDatagram::getInt(p + 16);
+      frame.version = FEATURE_FRAME_VERSION;
+      p += 20;
+      float* features = FrameDatagram::features(frame);
+      for (int i = 0; i < FrameDatagram::N_FEATURES; i++, p += 4)
+        features[i] = FrameDatagram::getFloat(p);
+      if (handler)
+        handler(subject, frame, context);
+      offset += FrameDatagram::OSC_FRAME_SIZE;
+      count++;
+    }
+    return count;
+  }
+};
+
+#endif
+
+#endif
@@ -27,18 +27,36 @@
  */
 #include "Heart.h"
 
+#ifdef BIODATA_PROFILE
+static const char* const HEART_PROFILE_STAGE_NAMES[] = { "quality", "bandpass", "minmax", "amplitude", "bpm", "threshold" };
+#endif
+
 //=============================================CONSTRUCTORS=============================================//
 // CONSTRUCTOR
-Heart::Heart(unsigned long rate) : 
+Heart::Heart(unsigned long rate, uint8_t features_) : 
     heartThresh(0.25, 0.4),              // if signal does not fall below (low, high) bounds than signal is ignored
     heartMinMaxSmoothing(0.1),
     heartSensorAmplitudeLop(0.001),
     heartSensorBpmLop(0.001),
     heartSensorAmplitudeLopValueMinMaxSmoothing(0.001),
-    heartSensorBpmLopValueMinMaxSmoothing(0.001)
+    heartSensorBpmLopValueMinMaxSmoothing(0.001),
+    heartBandpassLow(0.5),
+    heartBandpassHigh(8),
+    heartBandpassEnabled(false),
+    features(features_),
+    trendDecimation(1),
+    heartSensorAmplitudeLopSmoothing(0.001),
+    heartSensorBpmLopSmoothing(0.001),
+    qualityGating(false)
+#ifdef BIODATA_PROFILE
+    , profiler(HEART_PROFILE_STAGE_NAMES)
+#endif
 {
-    initialize(rate);
+    updateTrendSmoothing();
+
+    // Start timer first: initialize() reads it.
     timer.start();
+    initialize(rate);
 } 
 
 //=================================================SET=============================================//
@@ -48,37 +66,82 @@ void Heart::initialize(unsigned long rate) {
     heartSensorBpmLop.reset();
     heartSensorAmplitudeLopValueMinMax.reset();
     heartSensorBpmLopValueMinMax.reset();
+    heartBandpass.reset();
+    trendPhase = 0;
+    trendAmplitudeSum = 0;
 
     heartSensorSignal = heartSensorFiltered = heartSensorAmplitude = 0;
-    bpmChronoStart = timer.getMillis();
+    heartSensorSignalValid = false;
+    heartSensorAmplitudeLopValue = heartSensorBpmLopValue = 0;
+    heartSensorAmplitudeLopValueMinMaxValue = heartSensorBpmLopValueMinMaxValue = 0.5;
+    bpmChronoStart = sampleMicros = timer.getMicros();
 
     bpm = 60;
     beat = false;
+    beatIntervalValid = true;
+    quality.reset();
 
-    prevSampleMicros = timer.getMicros();
+    sampleClock.reset(timer.getMicros());
+    resampler.reset();
 
     setSampleRate(rate);
 }
 
 
+void Heart::setFeatures(uint8_t features_)
+{
+    features = features_;
+}
+
+void Heart::setTrendDecimation(uint8_t factor)
+{
+    trendDecimation = factor > 0 ? factor : 1;
+    trendPhase = 0;
+    trendAmplitudeSum = 0;
+    updateTrendSmoothing();
+}
+
 void Heart::setAmplitudeSmoothing(float smoothing)
 {
-    heartSensorAmplitudeLop.setSmoothing(smoothing);
+    heartSensorAmplitudeLopSmoothing = clamp(smoothing, 0, 1);
+    updateTrendSmoothing();
 }
 
 void Heart::setBpmSmoothing(float smoothing)
 {
-    heartSensorBpmLop.setSmoothing(smoothing);
+    heartSensorBpmLopSmoothing = clamp(smoothing, 0, 1);
+    updateTrendSmoothing();
 }
 
 void Heart::setAmplitudeMinMaxSmoothing(float smoothing)
 {
     heartSensorAmplitudeLopValueMinMaxSmoothing = clamp(smoothing, 0, 1);
+    updateTrendSmoothing();
 }
 
 void Heart::setBpmMinMaxSmoothing(float smoothing)
 {
     heartSensorBpmLopValueMinMaxSmoothing = clamp(smoothing, 0, 1);
+    updateTrendSmoothing();
+}
+
+// Smoothing factor to apply once every n samples to match an exponential
+// moving average applied at every sample with given smoothing.
+static float decimatedSmoothing(float smoothing, uint8_t n)
+{
+    return (n == 1) ? smoothing : 1 - pow(1 - smoothing, n);
+}
+
+void Heart::updateTrendSmoothing()
+{
+    heartSensorAmplitudeLop.setSmoothing(decimatedSmoothing(heartSensorAmplitudeLopSmoothing, trendDecimation));
+    heartSensorBpmLop.setSmoothing(decimatedSmoothing(heartSensorBpmLopSmoothing, trendDecimation));
+
+    // MinMax::adapt() squares its smoothing factor.
+    trendAmplitudeMinMaxSmoothing = (trendDecimation == 1) ? heartSensorAmplitudeLopValueMinMaxSmoothing :
+        sqrt(decimatedSmoothing(sqr(heartSensorAmplitudeLopValueMinMaxSmoothing), trendDecimation));
+    trendBpmMinMaxSmoothing = (trendDecimation == 1) ? heartSensorBpmLopValueMinMaxSmoothing :
+        sqrt(decimatedSmoothing(sqr(heartSensorBpmLopValueMinMaxSmoothing), trendDecimation));
 }
 
 void Heart::setMinMaxSmoothing(float smoothing)
@@ -86,19 +149,100 @@ void Heart::setMinMaxSmoothing(float smoothing)
     heartMinMaxSmoothing = clamp(smoothing, 0, 1);
 }
 
+void Heart::setBeatThresholds(float low, float high)
+{
+    heartThresh.setBounds(low, high);
+}
+
+void Heart::setBandpass(float low, float high)
+{
+    heartBandpassLow = low;
+    heartBandpassHigh = high;
+    heartBandpassEnabled = true;
+    heartBandpass.setDesign(BiquadDesign<2>::butterworthBandpass(_sampleRate, heartBandpassLow, heartBandpassHigh));
+    heartBandpass.reset();
+}
+
+void Heart::disableBandpass()
+{
+    heartBandpassEnabled = false;
+}
+
+void Heart::setQualityGating(bool enabled)
+{
+    qualityGating = enabled;
+    quality.reset();
+}
+
+SignalQuality& Heart::getQuality()
+{
+    return quality;
+}
+
+const SignalQuality& Heart::getQuality() const
+{
+    return quality;
+}
+
 void Heart::setSampleRate(unsigned long rate) {
     _sampleRate = rate;
-    microsBetweenSamples = 1000000UL / _sampleRate;
+    sampleClock.setPeriod(1000000UL / _sampleRate);
+    resampler.setPeriod(sampleClock.getPeriod());
+    quality.setSampleRate(_sampleRate);
+
+    // Coefficients depend on the sample rate.
+    if (heartBandpassEnabled)
+        setBandpass(heartBandpassLow, heartBandpassHigh);
 }
 
 void Heart::update(float signal) {
+    float previousSignal = heartSensorSignalValid ? heartSensorSignal : signal;
     heartSensorSignal = signal;
-    unsigned long t = timer.getMicros();
-    if (t - prevSampleMicros >= microsBetweenSamples) {
-        // Perform updates.
-        sample(signal);
-        prevSampleMicros = t;
-    }
+    heartSensorSignalValid = true;
+    unsigned long n = sampleClock.tick(timer.getMicros());
+
+    // Perform updates. When catching up, samples due since the previous call
+    // are interpolated between the previous and current signal (held at the
+    // current signal before the first one).
+    unsigned long t = sampleClock.getLastMicros();
+    for (unsigned long k = 1; k <= n; k++)
+        sample(previousSignal + (signal - previousSignal) * k / n, t - (n - k) * sampleClock.getPeriod());
+}
+
+void Heart::update(float signal, unsigned long timestampMicros) {
+    heartSensorSignal = signal;
+    heartSensorSignalValid = true;
+    resampler.push(signal, timestampMicros);
+
+    float value;
+    unsigned long t;
+    while (resampler.next(value, t))
+        sample(value, t);
+}
+
+void Heart::updateBlock(const float* signals, const unsigned long* timestampsMicros, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        update(signals[i], timestampsMicros[i]);
+}
+
+void Heart::setCatchUp(unsigned int maxSamples) {
+    sampleClock.setCatchUp(maxSamples);
+}
+
+unsigned long Heart::getMissedSamples() const {
+    return sampleClock.getMissedCount();
+}
+
+unsigned long Heart::getWorstLateness() const {
+    return sampleClock.getWorstLateness();
+}
+
+float Heart::getEffectiveSampleRate() const {
+    return sampleClock.getEffectiveRate();
+}
+
+void Heart::setEventHandler(BioEventHandler handler, void* context) {
+    events.setHandler(handler, context);
 }
 
 float Heart::getNormalized() const {
@@ -125,29 +269,142 @@ int32_t Heart::getRaw() const {
     return heartSensorSignal;
 }
 
+size_t Heart::saveState(uint8_t* buffer, size_t size) const {
+    return saveStateBlob(*this, STATE_HEART, buffer, size);
+}
+
+bool Heart::loadState(const uint8_t* buffer, size_t size) {
+    return loadStateBlob(*this, STATE_HEART, buffer, size);
+}
+
+void Heart::saveState(StateWriter& out) const {
+    heartMinMax.saveState(out);
+    heartThresh.saveState(out);
+    heartBandpass.saveState(out);
+    heartSensorAmplitudeLop.saveState(out);
+    heartSensorBpmLop.saveState(out);
+    heartSensorAmplitudeLopValueMinMax.saveState(out);
+    heartSensorBpmLopValueMinMax.saveState(out);
+
+    out.write(heartSensorFiltered);
+    out.write(heartSensorAmplitude);
+    out.write(heartSensorAmplitudeLopValue);
+    out.write(heartSensorBpmLopValue);
+    out.write(heartSensorAmplitudeLopValueMinMaxValue);
+    out.write(heartSensorBpmLopValueMinMaxValue);
+    out.write(bpm);
+    out.write(trendAmplitudeSum);
+    out.write(trendPhase);
+}
+
+bool Heart::loadState(StateReader& in) {
+    // Check size first so that the state is either fully loaded or untouched.
+    StateWriter expected(NULL, 0);
+    saveState(expected);
+    if (in.getAvailable() < expected.getSize())
+        return false;
+
+    heartMinMax.loadState(in);
+    heartThresh.loadState(in);
+    heartBandpass.loadState(in);
+    heartSensorAmplitudeLop.loadState(in);
+    heartSensorBpmLop.loadState(in);
+    heartSensorAmplitudeLopValueMinMax.loadState(in);
+    heartSensorBpmLopValueMinMax.loadState(in);
+
+    in.read(heartSensorFiltered);
+    in.read(heartSensorAmplitude);
+    in.read(heartSensorAmplitudeLopValue);
+    in.read(heartSensorBpmLopValue);
+    in.read(heartSensorAmplitudeLopValueMinMaxValue);
+    in.read(heartSensorBpmLopValueMinMaxValue);
+    in.read(bpm);
+    in.read(trendAmplitudeSum);
+    in.read(trendPhase);
+    if (trendPhase >= trendDecimation) { // saved with another trend decimation
+        trendPhase = 0;
+        trendAmplitudeSum = 0;
+    }
+
+    // Time bases are not saved: restart them now.
+    beat = false;
+    beatIntervalValid = true;
+    quality.reset();
+    bpmChronoStart = sampleMicros = timer.getMicros();
+    sampleClock.reset(sampleMicros);
+    resampler.reset();
+    return true;
+}
+
 void Heart::sample(float signal) {
+    sample(signal, timer.getMicros());
+}
+
+void Heart::sample(float signal, unsigned long timestampMicros) {
+    sampleMicros = timestampMicros;
+
     // Read analog value if needed.
     heartSensorSignal = signal;
+    heartSensorSignalValid = true;
 
-    heartSensorFiltered = heartMinMax.filter(heartSensorSignal);
-    heartSensorAmplitude = heartMinMax.getMax() - heartMinMax.getMin();
-    heartMinMax.adapt(heartMinMaxSmoothing); // APPLY A LOW PASS ADAPTION FILTER TO THE MIN AND MAX
+    if (qualityGating) {
+        BIODATA_PROFILE_STAGE(profiler, PROFILE_QUALITY);
+        if (!quality.update(signal)) {
+            // Artifacts would stretch the normalization range and the beat
+            // interval spanning them is meaningless.
+            beat = false;
+            beatIntervalValid = false;
+            return;
+        }
+    }
 
-    heartSensorAmplitudeLopValue = heartSensorAmplitudeLop.filter(heartSensorAmplitude);
-    heartSensorBpmLopValue =  heartSensorBpmLop.filter(bpm);
+    if (heartBandpassEnabled) {
+        BIODATA_PROFILE_STAGE(profiler, PROFILE_BANDPASS);
+        signal = heartBandpass.filter(signal);
+    }
 
-    heartSensorAmplitudeLopValueMinMaxValue = heartSensorAmplitudeLopValueMinMax.filter(heartSensorAmplitudeLopValue);
-    heartSensorAmplitudeLopValueMinMax.adapt(heartSensorAmplitudeLopValueMinMaxSmoothing);
-    heartSensorBpmLopValueMinMaxValue = heartSensorBpmLopValueMinMax.filter(heartSensorBpmLopValue);
-    heartSensorBpmLopValueMinMax.adapt(heartSensorBpmLopValueMinMaxSmoothing);
+    {
+        BIODATA_PROFILE_STAGE(profiler, PROFILE_MINMAX);
+        heartSensorFiltered = heartMinMax.filter(signal);
+        heartSensorAmplitude = heartMinMax.getMax() - heartMinMax.getMin();
+        heartMinMax.adapt(heartMinMaxSmoothing); // APPLY A LOW PASS ADAPTION FILTER TO THE MIN AND MAX
+    }
+
+    if (features & (HEART_AMPLITUDE_CHANGE | HEART_BPM_CHANGE)) {
+        trendAmplitudeSum += heartSensorAmplitude;
+        if (++trendPhase >= trendDecimation) {
+            float amplitude = trendAmplitudeSum / trendPhase;
+            trendAmplitudeSum = 0;
+            trendPhase = 0;
+
+            if (features & HEART_AMPLITUDE_CHANGE) {
+                BIODATA_PROFILE_STAGE(profiler, PROFILE_AMPLITUDE);
+                heartSensorAmplitudeLopValue = heartSensorAmplitudeLop.filter(amplitude);
+                heartSensorAmplitudeLopValueMinMaxValue = heartSensorAmplitudeLopValueMinMax.filter(heartSensorAmplitudeLopValue);
+                heartSensorAmplitudeLopValueMinMax.adapt(trendAmplitudeMinMaxSmoothing);
+            }
+
+            if (features & HEART_BPM_CHANGE) {
+                BIODATA_PROFILE_STAGE(profiler, PROFILE_BPM);
+                heartSensorBpmLopValue =  heartSensorBpmLop.filter(bpm);
+                heartSensorBpmLopValueMinMaxValue = heartSensorBpmLopValueMinMax.filter(heartSensorBpmLopValue);
+                heartSensorBpmLopValueMinMax.adapt(trendBpmMinMaxSmoothing);
+            }
+        }
+    }
 
+    BIODATA_PROFILE_STAGE(profiler, PROFILE_THRESHOLD);
     beat = heartThresh.detect(heartSensorFiltered);
 
     if ( beat ) {
-        unsigned long ms = timer.getMillis();
-        float temporaryBpm = 60000. / (ms - bpmChronoStart);
-        bpmChronoStart = ms;
-        if ( temporaryBpm > 30 && temporaryBpm < 200 ) // make sure the BPM is within bounds
+        // Beat interval is measured on sample time rather than on the time
+        // at which samples are processed.
+        unsigned long interval = sampleMicros - bpmChronoStart;
+        float temporaryBpm = 60000000. / interval;
+        bpmChronoStart = sampleMicros;
+        events.emit(EVENT_BEAT, sampleMicros, interval / 1000.0f, this);
+        if ( beatIntervalValid && temporaryBpm > 30 && temporaryBpm < 200 ) // make sure the BPM is within bounds
             bpm = temporaryBpm;
+        beatIntervalValid = true;
     }
 }
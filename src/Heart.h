@@ -27,15 +27,29 @@
  */
 
 #include "Average.h"
+#include "Biquad.h"
+#include "Events.h"
 #include "MinMax.h"
 #include "Threshold.h"
 #include "Lop.h"
+#include "Profiler.h"
+#include "Resampler.h"
+#include "SampleClock.h"
+#include "SignalQuality.h"
+#include "State.h"
 #include "Timing.h"
 #include "utils.h"
 
 #ifndef HEART_H_
 #define HEART_H_
 
+/// Optional outputs of Heart (beat detection and BPM are always computed).
+enum HeartFeature {
+    HEART_AMPLITUDE_CHANGE = 0x01, // amplitudeChange()
+    HEART_BPM_CHANGE       = 0x02, // bpmChange()
+    HEART_ALL_FEATURES     = 0x03
+};
+
 class Heart {
     
     unsigned long bpmChronoStart;
@@ -63,20 +77,81 @@ class Heart {
     float heartSensorAmplitude;
     
     float heartSensorSignal;
+    bool heartSensorSignalValid; // false until the first sample (nothing to interpolate from)
+    
+    // Optional band-pass applied before normalization.
+    BiquadCascade<2> heartBandpass;
+    float heartBandpassLow;
+    float heartBandpassHigh;
+    bool heartBandpassEnabled;
     
     float bpm;  // this value is fed to initialize your BPM before a heartbeat is detected
     
     bool beat;
     
+    // Enabled optional outputs (see HeartFeature).
+    uint8_t features;
+    
+    // The slow amplitude and BPM trend chains run once every trendDecimation
+    // samples, on the mean amplitude over that period, with smoothing factors
+    // adjusted to keep the same time constants.
+    uint8_t trendDecimation;
+    uint8_t trendPhase;
+    float trendAmplitudeSum;
+    float heartSensorAmplitudeLopSmoothing;
+    float heartSensorBpmLopSmoothing;
+    float trendAmplitudeMinMaxSmoothing;
+    float trendBpmMinMaxSmoothing;
+    
+    // Applies smoothing factors to the trend chains according to trendDecimation.
+    void updateTrendSmoothing();
+    
     // Sample rate in Hz.
     unsigned long _sampleRate;
     
-    // Internal use.
-    unsigned long microsBetweenSamples;
-    unsigned long prevSampleMicros;
+    // Internal use: decides when update() samples and tracks missed samples.
+    SampleClock sampleClock;
+    
+    // Time of the sample being processed (microseconds).
+    unsigned long sampleMicros;
     
+    // Brings timestamped samples onto the sample rate grid.
+    Resampler resampler;
+    
+    // Receives beat events.
+    EventEmitter events;
+    
+    // Signal quality of the raw signal. When gating, bad samples are skipped
+    // and the first beat after them does not update the BPM.
+    SignalQuality quality;
+    bool qualityGating;
+    bool beatIntervalValid;
+    
+#ifdef BIODATA_PROFILE
 public:
-    Heart(unsigned long rate=200); // default samplerate is 200Hz
+    /// Stages of sample() measured when BIODATA_PROFILE is defined.
+    enum ProfileStage {
+        PROFILE_QUALITY,    // signal quality (when gating)
+        PROFILE_BANDPASS,   // optional band-pass
+        PROFILE_MINMAX,     // normalization: MinMax filter and adapt
+        PROFILE_AMPLITUDE,  // amplitude Lop -> MinMax chain
+        PROFILE_BPM,        // BPM Lop -> MinMax chain
+        PROFILE_THRESHOLD,  // beat detection and BPM computation
+        N_PROFILE_STAGES
+    };
+    typedef StageProfiler<N_PROFILE_STAGES> Profiler;
+
+private:
+    Profiler profiler;
+#endif
+
+public:
+    /**
+     * Constructor. Default samplerate is 200Hz. Outputs not listed in
+     * features (see HeartFeature) are not computed, eg. Heart(200, 0)
+     * only detects beats and BPM.
+     */
+    Heart(unsigned long rate=200, uint8_t features=HEART_ALL_FEATURES);
     virtual ~Heart() {}
 
     Timing timer;
@@ -87,9 +162,49 @@ public:
     void setBpmMinMaxSmoothing(float smoothing);
     void setMinMaxSmoothing(float smoothing);
     
+    /**
+     * Sets the bounds of beat detection on the normalized signal: a beat is
+     * detected when the signal rises above high after falling below low.
+     * Defaults are 0.25 and 0.4.
+     */
+    void setBeatThresholds(float low, float high);
+    
+    /**
+     * Applies a 4th-order Butterworth band-pass between low and high (Hz) to
+     * the signal before normalization and beat detection, eg. setBandpass(0.5, 8)
+     * for PPG. Disabled by default.
+     */
+    void setBandpass(float low, float high);
+    
+    /// Disables band-pass filtering.
+    void disableBandpass();
+    
+    /**
+     * Skips samples of bad quality (clipping, flatline, motion...; see
+     * SignalQuality): normalization, trends and beat detection hold their
+     * state until the signal is good again. Disabled by default.
+     */
+    void setQualityGating(bool enabled=true);
+    
+    /// Returns signal quality estimation (eg. to adjust its settings).
+    SignalQuality& getQuality();
+    
+    /// Returns signal quality of the last sample (only updated when gating).
+    const SignalQuality& getQuality() const;
+    
     /// Initializes.
     void initialize(unsigned long rate=200);
     
+    /// Sets which optional outputs are computed (see HeartFeature).
+    void setFeatures(uint8_t features);
+    
+    /**
+     * Runs the slow amplitudeChange() and bpmChange() chains once every
+     * factor samples instead of at every sample, with equivalent time
+     * constants. Beat detection keeps running at the full rate. Default is 1.
+     */
+    void setTrendDecimation(uint8_t factor);
+    
     /// Sets sample rate.
     void setSampleRate(unsigned long rate=200);
     
@@ -100,6 +215,38 @@ public:
      */
     void update(float signal = 0);
     
+    /**
+     * Same as update(signal) but for a sample taken at timestampMicros (eg.
+     * a hardware timestamp). Samples are interpolated onto the sample rate
+     * grid, so bursts of late samples do not distort beat intervals.
+     */
+    void update(float signal, unsigned long timestampMicros);
+    
+    /// Calls update(signal, timestampMicros) on n timestamped samples.
+    void updateBlock(const float* signals, const unsigned long* timestampsMicros, size_t n);
+    
+    /**
+     * When update() is called late, processes up to maxSamples of the elapsed
+     * sample periods (interpolating the signal) instead of a single sample.
+     * Default is 1 (no catch-up).
+     */
+    void setCatchUp(unsigned int maxSamples);
+    
+    /// Returns number of sample periods skipped by update() since initialization.
+    unsigned long getMissedSamples() const;
+    
+    /// Returns worst delay of update() past a sample due time (microseconds).
+    unsigned long getWorstLateness() const;
+    
+    /// Returns the rate at which update() actually processed samples (Hz).
+    float getEffectiveSampleRate() const;
+    
+    /**
+     * Sends an EVENT_BEAT to handler at each detected beat, with the
+     * inter-beat interval in milliseconds as value (NULL to disable).
+     */
+    void setEventHandler(BioEventHandler handler, void* context=NULL);
+    
     /// Get normalized heartrate signal.
     float getNormalized() const;
     
@@ -126,9 +273,40 @@ public:
      */
     float bpmChange() const;
     
+    /**
+     * Saves the state of the sensor (normalization, baselines, BPM...) into
+     * buffer so that it can resume without calibrating again. Returns the
+     * size of the state: if larger than size, nothing usable was written.
+     */
+    size_t saveState(uint8_t* buffer, size_t size) const;
+    
+    /**
+     * Restores state saved by saveState() into a sensor with the same
+     * settings. Returns false and keeps the current state if the data is
+     * invalid. Beat interval timing restarts at the time of the call.
+     */
+    bool loadState(const uint8_t* buffer, size_t size);
+    
+    /// Writes state without header (eg. to embed it in a larger snapshot).
+    void saveState(StateWriter& out) const;
+    
+    /// Reads state written by saveState(StateWriter&).
+    bool loadState(StateReader& in);
+    
+#ifdef BIODATA_PROFILE
+    /// Returns per-stage durations of sample().
+    const Profiler& getProfiler() const { return profiler; }
+    
+    /// Clears per-stage durations.
+    void resetProfiler() { profiler.reset(); }
+#endif
+    
     // Performs the actual adjustments of signals and filterings.
     // Internal use: don't use directly, use update() instead.
     void sample(float signal = 0);
+    
+    // Same as sample(signal) for a sample taken at timestampMicros.
+    void sample(float signal, unsigned long timestampMicros);
 };
 
 #endif
\ No newline at end of file
@@ -26,6 +26,8 @@
  #ifndef HIP_H_
  #define HIP_H_
 
+#include "State.h"
+
 class Hip {
   float value;
   float previousInput;
@@ -34,12 +36,34 @@ class Hip {
  public:
   Hip(float hip ) {
     this->hip = hip;
+    reset();
     };
+
+  /// Resets filter.
+  void reset() {
+    value = previousInput = 0;
+  }
     
   float filter( float input) {
     value =  hip * ( value + input - previousInput);
     previousInput = input;
     return value;
   }
+
+  /// Writes filter state.
+  void saveState(StateWriter& out) const {
+    out.write(value);
+    out.write(previousInput);
+  }
+
+  /// Reads filter state. Returns false if data is missing.
+  bool loadState(StateReader& in) {
+    float state[2];
+    if (!in.read(state))
+      return false;
+    value = state[0];
+    previousInput = state[1];
+    return true;
+  }
 };
 #endif
@@ -24,6 +24,7 @@
 #ifndef LOP_H_
 #define LOP_H_
 
+#include "State.h"
 #include "utils.h"
 
 class Lop {
@@ -82,6 +83,23 @@ public:
     return value;
   }
 
+  /// Writes filter state.
+  void saveState(StateWriter& out) const {
+    out.write(value);
+    out.write((uint32_t)n);
+  }
+
+  /// Reads filter state. Returns false if data is missing.
+  bool loadState(StateReader& in) {
+    float value_;
+    uint32_t n_;
+    if (!in.read(value_) || !in.read(n_))
+      return false;
+    value = value_;
+    n = n_;
+    return true;
+  }
+
 };
 
 #endif
@@ -28,6 +28,7 @@
 #ifndef MIN_MAX_H_
 #define MIN_MAX_H_
 
+#include "State.h"
 #include "utils.h"
 
 class MinMax {
@@ -77,15 +78,56 @@ class MinMax {
       return value;
     }
 
-    float getMax() {
+    float getMax() const {
       return max;
     }
 
-    float getMin() {
+    float getMin() const {
       return min;
     }
 
+    /// Writes filter state.
+    void saveState(StateWriter& out) const {
+      out.write(input);
+      out.write(min);
+      out.write(max);
+      out.write(value);
+      out.write((uint8_t)firstPass);
+    }
+
+    /// Reads filter state. Returns false if data is missing.
+    bool loadState(StateReader& in) {
+      float state[4];
+      uint8_t firstPass_;
+      if (!in.read(state) || !in.read(firstPass_))
+        return false;
+      input = state[0];
+      min   = state[1];
+      max   = state[2];
+      value = state[3];
+      firstPass = firstPass_;
+      return true;
+    }
+
+
+};
+
+/// MinMax that adapts its bounds after every sample (eg. for use in a Pipeline).
+class AdaptiveMinMax : public MinMax {
+    float smoothing;
 
+  public:
+    AdaptiveMinMax(float smoothing_=0.1) : smoothing(smoothing_) {}
+
+    void setSmoothing(float smoothing_) {
+      smoothing = smoothing_;
+    }
+
+    float filter(float f) {
+      float value = MinMax::filter(f);
+      adapt(smoothing);
+      return value;
+    }
 };
 
 #endif
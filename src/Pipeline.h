@@ -0,0 +1,106 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Compile-time composition of filters into a processing chain.
+ *
+ * Any object with a float filter(float) method and a void reset() method
+ * can be a stage (Lop, Hip, Biquad, BiquadCascade, AdaptiveMinMax,
+ * Threshold...). Stages are stored by value inside the pipeline, one after
+ * the other, and the chain is resolved at compile time: filter() inlines to
+ * the sequence of stage computations with no virtual calls and no
+ * intermediate member variables.
+ *
+ *   auto beats = pipeline(Hip(0.99), Lop(0.2), AdaptiveMinMax(0.1), Threshold(0.25, 0.4));
+ *   ...
+ *   bool beat = beats.filter(analogRead(A1));
+ *   float amplitude = beats.get<2>().getMax() - beats.get<2>().getMin(); // stages are accessed by index
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <stddef.h>
+
+template <class... Stages>
+class Pipeline;
+
+template <size_t INDEX, class P>
+struct PipelineStage;
+
+// Empty pipeline: passes values through.
+template <>
+class Pipeline<> {
+public:
+  float filter(float input) { return input; }
+  void reset() {}
+};
+
+template <class Stage, class... Others>
+class Pipeline<Stage, Others...> {
+  Stage stage;
+  Pipeline<Others...> others;
+
+  template <size_t INDEX, class P>
+  friend struct PipelineStage;
+
+public:
+  /// Constructor.
+  Pipeline(const Stage& stage_, const Others&... others_) : stage(stage_), others(others_...) {}
+
+  /// Filters sample through all stages and returns output of the last one.
+  float filter(float input) {
+    return others.filter(stage.filter(input));
+  }
+
+  /// Resets all stages.
+  void reset() {
+    stage.reset();
+    others.reset();
+  }
+
+  /// Returns the stage at given index (0 = first stage).
+  template <size_t INDEX>
+  typename PipelineStage<INDEX, Pipeline>::Type& get() {
+    return PipelineStage<INDEX, Pipeline>::get(*this);
+  }
+
+  template <size_t INDEX>
+  const typename PipelineStage<INDEX, Pipeline>::Type& get() const {
+    return PipelineStage<INDEX, Pipeline>::get(const_cast<Pipeline&>(*this));
+  }
+};
+
+// Stage lookup by index.
+template <class Stage, class... Others>
+struct PipelineStage<0, Pipeline<Stage, Others...> > {
+  typedef Stage Type;
+  static Type& get(Pipeline<Stage, Others...>& p) { return p.stage; }
+};
+
+template <size_t INDEX, class Stage, class... Others>
+struct PipelineStage<INDEX, Pipeline<Stage, Others...> > {
+  typedef typename PipelineStage<INDEX - 1, Pipeline<Others...> >::Type Type;
+  static Type& get(Pipeline<Stage, Others...>& p) { return PipelineStage<INDEX - 1, Pipeline<Others...> >::get(p.others); }
+};
+
+/// Builds a pipeline from stages, applied in the order given.
+template <class... Stages>
+Pipeline<Stages...> pipeline(const Stages&... stages) {
+  return Pipeline<Stages...>(stages...);
+}
+
+#endif
@@ -0,0 +1,189 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Optional per-stage latency instrumentation of the sensor pipelines.
+ *
+ * Instrumentation is compiled in only when BIODATA_PROFILE is defined for
+ * the whole build (eg. build_flags = -DBIODATA_PROFILE with PlatformIO, or
+ * -DBIODATA_PROFILE with CMake), since it changes the layout of the sensor
+ * classes. Otherwise BIODATA_PROFILE_STAGE() expands to nothing and the
+ * sensors carry no profiler.
+ *
+ * Durations are measured in CPU cycles on Cortex-M boards that expose the
+ * DWT cycle counter (eg. Teensy 3.x/4.x), in microseconds on other Arduino
+ * boards, and in nanoseconds on a host computer.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#ifdef BIODATA_PROFILE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+/// Time source of the profiler.
+struct ProfilerClock {
+  /// Returns current time in ticks.
+  static uint32_t ticks() {
+#if defined(ARM_DWT_CYCCNT)
+    return ARM_DWT_CYCCNT;
+#elif defined(ARDUINO)
+    return micros();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  /// Unit of ticks.
+  static const char* unit() {
+#if defined(ARM_DWT_CYCCNT)
+    return "cycles";
+#elif defined(ARDUINO)
+    return "us";
+#else
+    return "ns";
+#endif
+  }
+
+  /// Starts the cycle counter if needed (it is off by default on Teensy 3.x).
+  static void begin() {
+#if defined(ARM_DWT_CYCCNT) && defined(ARM_DEMCR)
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+  }
+};
+
+/**
+ * Duration statistics of the N_STAGES stages of a pipeline. Each stage keeps
+ * a count, total, worst case and a histogram with power-of-two buckets:
+ * bucket b counts durations in [2^(b-1), 2^b) ticks (bucket 0: zero ticks).
+ */
+template <uint8_t N_STAGES>
+class StageProfiler {
+public:
+  static const uint8_t N_BUCKETS = 24;
+
+  struct Stage {
+    uint32_t count;
+    uint32_t worst;
+    uint64_t total;
+    uint32_t histogram[N_BUCKETS];
+  };
+
+  /// Constructor. Names are used by dump() and must outlive the profiler.
+  StageProfiler(const char* const* names_) : names(names_) {
+    ProfilerClock::begin();
+    reset();
+  }
+
+  /// Clears all statistics.
+  void reset() {
+    for (uint8_t s = 0; s < N_STAGES; s++) {
+      stages[s].count = stages[s].worst = 0;
+      stages[s].total = 0;
+      for (uint8_t b = 0; b < N_BUCKETS; b++)
+        stages[s].histogram[b] = 0;
+    }
+  }
+
+  /// Adds a measurement of given duration (in ticks) to a stage.
+  void record(uint8_t stage, uint32_t ticks) {
+    Stage& st = stages[stage];
+    st.count++;
+    st.total += ticks;
+    if (ticks > st.worst) st.worst = ticks;
+    uint8_t bucket = ticks ? 32 - __builtin_clz(ticks) : 0;
+    st.histogram[bucket < N_BUCKETS ? bucket : N_BUCKETS - 1]++;
+  }
+
+  /// Number of stages.
+  static uint8_t nStages() { return N_STAGES; }
+
+  /// Returns statistics of a stage.
+  const Stage& getStage(uint8_t stage) const { return stages[stage]; }
+
+  /// Returns name of a stage.
+  const char* getName(uint8_t stage) const { return names[stage]; }
+
+  /**
+   * Writes a text summary (one line per stage) into buffer. Returns the
+   * number of characters that the full summary needs, like snprintf().
+   */
+  size_t dump(char* buffer, size_t size) const {
+    size_t n = 0;
+    for (uint8_t s = 0; s < N_STAGES; s++) {
+      const Stage& st = stages[s];
+      unsigned long mean = st.count ? (unsigned long)(st.total / st.count) : 0;
+      n += print(buffer, size, n, "%s: n=%lu mean=%lu worst=%lu %s hist=",
+                 names[s], (unsigned long)st.count, mean, (unsigned long)st.worst, ProfilerClock::unit());
+      // Skip empty buckets at the top of the histogram.
+      uint8_t last = N_BUCKETS;
+      while (last > 1 && st.histogram[last - 1] == 0) last--;
+      for (uint8_t b = 0; b < last; b++)
+        n += print(buffer, size, n, b ? ",%lu" : "%lu", (unsigned long)st.histogram[b]);
+      n += print(buffer, size, n, "\n");
+    }
+    return n;
+  }
+
+private:
+  template <typename... Args>
+  static size_t print(char* buffer, size_t size, size_t offset, const char* format, Args... args) {
+    int n = snprintf(offset < size ? buffer + offset : NULL, offset < size ? size - offset : 0, format, args...);
+    return n > 0 ? n : 0;
+  }
+
+  const char* const* names;
+  Stage stages[N_STAGES];
+};
+
+/// Records the duration of the enclosing scope into a stage of a profiler.
+template <class Profiler>
+class ProfileScope {
+  Profiler& profiler;
+  uint8_t stage;
+  uint32_t start;
+
+public:
+  ProfileScope(Profiler& profiler_, uint8_t stage_) : profiler(profiler_), stage(stage_), start(ProfilerClock::ticks()) {}
+  ~ProfileScope() { profiler.record(stage, ProfilerClock::ticks() - start); }
+};
+
+#define BIODATA_PROFILE_CONCAT_(a, b) a##b
+#define BIODATA_PROFILE_CONCAT(a, b) BIODATA_PROFILE_CONCAT_(a, b)
+
+/// Measures the rest of the enclosing scope as given stage of profiler.
+#define BIODATA_PROFILE_STAGE(profiler, stage) \
+  ProfileScope<decltype(profiler)> BIODATA_PROFILE_CONCAT(_profileScope, __LINE__)(profiler, stage)
+
+#else
+
+#define BIODATA_PROFILE_STAGE(profiler, stage)
+
+#endif
+
+#endif
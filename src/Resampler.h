@@ -0,0 +1,109 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Resamples irregularly timestamped samples onto a regular time grid using
+ * linear interpolation. Used by the sensors to process samples that arrive
+ * in bursts (eg. batched by a radio or USB link) at their nominal rate.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESAMPLER_H_
+#define RESAMPLER_H_
+
+class Resampler {
+
+  // Gaps longer than this (eg. sensor unplugged) are not interpolated: the
+  // grid restarts at the next sample instead.
+  static const unsigned long MAX_GAP_MICROS = 1000000UL;
+
+  // Grid period.
+  unsigned long period;
+
+  // Time of next grid point.
+  unsigned long nextMicros;
+
+  // Current input segment.
+  unsigned long prevMicros;
+  float prevValue;
+  unsigned long lastMicros;
+  float lastValue;
+
+  bool started;
+
+public:
+  /// Constructor.
+  Resampler(unsigned long periodMicros=5000) {
+    setPeriod(periodMicros);
+    reset();
+  }
+
+  /// Resets resampler.
+  void reset() {
+    nextMicros = prevMicros = lastMicros = 0;
+    prevValue = lastValue = 0;
+    started = false;
+  }
+
+  /// Sets the period of the output grid in microseconds.
+  void setPeriod(unsigned long periodMicros) {
+    period = periodMicros > 0 ? periodMicros : 1;
+  }
+
+  /**
+   * Adds a sample taken at timestampMicros. Timestamps must increase (modulo
+   * wrap-around); samples older than the previous one are ignored. Call
+   * next() until it returns false to get the grid points covered so far.
+   */
+  void push(float value, unsigned long timestampMicros) {
+    if (!started) {
+      started = true;
+      nextMicros = timestampMicros;
+    }
+    else if ((long)(timestampMicros - lastMicros) <= 0) {
+      return;
+    }
+    else if (timestampMicros - lastMicros > MAX_GAP_MICROS) {
+      nextMicros = timestampMicros;
+    }
+
+    prevMicros = lastMicros;
+    prevValue = lastValue;
+    lastMicros = timestampMicros;
+    lastValue = value;
+  }
+
+  /**
+   * Gets the next grid point up to the last pushed sample. Returns false
+   * when there are none left.
+   */
+  bool next(float& value, unsigned long& timestampMicros) {
+    if (!started || (long)(nextMicros - lastMicros) > 0)
+      return false;
+
+    unsigned long span = lastMicros - prevMicros;
+    unsigned long offset = nextMicros - prevMicros;
+    if (span == 0 || offset >= span)
+      value = lastValue;
+    else
+      value = prevValue + (lastValue - prevValue) * ((float)offset / (float)span);
+
+    timestampMicros = nextMicros;
+    nextMicros += period;
+    return true;
+  }
+};
+
+#endif
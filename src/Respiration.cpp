@@ -29,10 +29,14 @@
  */
 #include "Respiration.h"
 
+#ifdef BIODATA_PROFILE
+static const char* const RESPIRATION_PROFILE_STAGE_NAMES[] = { "peakOrTrough", "amplitude", "rpm" };
+#endif
+
 
 //=============================================CONSTRUCTORS=============================================//
 // CONSTRUCTOR
-Respiration::Respiration(unsigned long rate) :
+Respiration::Respiration(unsigned long rate, uint8_t features) :
   normalizer(normalizerMean, normalizerStdDev, normalizerTimeWindow),
   amplitudeNormalizer(normalizerMean, normalizerStdDev, amplitudeNormalizerTimeWindow),
   normalizerForAmplitudeVariability(normalizerMean, normalizerStdDev, normalizerForAmplitudeVariabilityTimeWindow),
@@ -48,6 +52,7 @@ Respiration::Respiration(unsigned long rate) :
   rpmLevelSmoother(rpmLevelSmootherFactor),
   rpmRateOfChangeSmoother(rpmRateOfChangeSmootherFactor),
   minMaxScaler(),
+  _features(features),
   _signal(0),
   _filteredSignal(0),
   _minMaxScaled(0.5),
@@ -64,6 +69,9 @@ Respiration::Respiration(unsigned long rate) :
   _rpmRateOfChange(0),
   _rpmCoefficientOfVariation(0),
   _millisPassed(0)
+#ifdef BIODATA_PROFILE
+  , profiler(RESPIRATION_PROFILE_STAGE_NAMES)
+#endif
   {
   initialize(rate);
   }
@@ -80,12 +88,28 @@ void Respiration::initialize(unsigned long rate) {
   //set scaler time window (same as normalizer)
   minMaxScaler.timeWindow(normalizerTimeWindow);
 
+  //reset sample clock
+  _sampleMicros = _intervalChrono = micros();
+  resampler.reset();
+
   //set sample rate
   setSampleRate(rate);
 }
 // Sets sample rate
 void Respiration::setSampleRate(unsigned long rate) {
+  _sampleRate = rate;
   sampleMetro.frequency(rate);
+  resampler.setPeriod(1000000UL / rate);
+}
+
+// Sets which optional outputs are computed
+void Respiration::setFeatures(uint8_t features) {
+  _features = features;
+}
+
+// Sets event handler
+void Respiration::setEventHandler(BioEventHandler handler, void* context) {
+  events.setHandler(handler, context);
 }
 
 //=============================================UPDATE=============================================//
@@ -97,13 +121,46 @@ void Respiration::update(float signal) {
   }
 }
 
+// Updates the signal from a timestamped sample
+void Respiration::update(float signal, unsigned long timestampMicros) {
+  resampler.push(signal, timestampMicros);
+
+  float value;
+  unsigned long t;
+  while (resampler.next(value, t)) {
+    sample(value, t);
+  }
+}
+
+// Updates the signal from n timestamped samples
+void Respiration::updateBlock(const float* signals, const unsigned long* timestampsMicros, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    update(signals[i], timestampsMicros[i]);
+  }
+}
+
 // Reads the signal and passes it to the signal processing functions
 void Respiration::sample(float signal) {
+  sample(signal, micros());
+}
+
+// Reads the signal taken at timestampMicros and passes it to the signal processing functions
+void Respiration::sample(float signal, unsigned long timestampMicros) {
+  _sampleMicros = timestampMicros;
   _signal = signal;
   if(_signal >= 0){ // if signal value is valid
-    peakOrTrough(_signal); // base signal processing
-    amplitude(_signal); // amplitude data processing
-    rpm(); // respiration rate data processing
+    {
+      BIODATA_PROFILE_STAGE(profiler, PROFILE_PEAK_OR_TROUGH);
+      peakOrTrough(_signal); // base signal processing
+    }
+    if (_features & RESPIRATION_AMPLITUDE) {
+      BIODATA_PROFILE_STAGE(profiler, PROFILE_AMPLITUDE);
+      amplitude(_signal); // amplitude data processing
+    }
+    if (_features & RESPIRATION_RPM) {
+      BIODATA_PROFILE_STAGE(profiler, PROFILE_RPM);
+      rpm(); // respiration rate data processing
+    }
   }
 }
 
@@ -121,31 +178,30 @@ void Respiration::peakOrTrough(float value){
 
   _filteredSignal >> minMaxScaledPeak;
   _filteredSignal >> minMaxScaledTrough;
+  bool wasExhaling = _exhale;
   _exhale = minMaxScaledPeak ? 0 : minMaxScaledTrough ? 1 : _exhale; 
   // _exhale =  _filteredSignal >= 0.5 ? 1 : 0;
   // store true if exhaling (when trough is detected ; temperature is rising again)
+
+  if (_exhale != wasExhaling) { // on exhale / inhale transitions
+    events.emit(_exhale ? EVENT_EXHALE : EVENT_INHALE, _sampleMicros, _filteredSignal, this);
+  }
 }
 
 // Amplitude data processing
 void Respiration::amplitude(float value){ 
-   // declare and initialize local variables
-  static float min = -FLT_MIN; // base signal value at lowest point in breath cycle
-  static float max = -FLT_MIN; // base signal value at highest point in breath cycle
-  static float amplitudes[numberOfCycles] = {}; // array of previous breath amplitudes
-  static int amplitudeIndex = 0; // index 
-  static float oldestAmplitude; // oldest breath amplitude in the array
-
   //AMPLITUDE 
   // find min and max values since last breath cycle
-  if (value < min) min = value; 
-  if (value > max) max = value;
+  if (value < _cycleMin) _cycleMin = value; 
+  if (value > _cycleMax) _cycleMax = value;
 
   if (minMaxScaledPeak){  // on every exhale peak
-    if(max > -FLT_MIN && min > -FLT_MIN && min < FLT_MAX){ // if min and max temperatures are valid
-      _amplitude = abs(max - min);  // calculate amplitude
+    if(_cycleMax > -FLT_MIN && _cycleMin > -FLT_MIN && _cycleMin < FLT_MAX){ // if min and max temperatures are valid
+      _amplitude = abs(_cycleMax - _cycleMin);  // calculate amplitude
+      events.emit(EVENT_BREATH_AMPLITUDE, _sampleMicros, _amplitude, this);
     }
-    min = FLT_MAX; // reset min to very high temperature
-    max = -FLT_MIN; // reset max to very low temperature
+    _cycleMin = FLT_MAX; // reset min to very high temperature
+    _cycleMax = -FLT_MIN; // reset max to very low temperature
   }
 
   if(_amplitude >0){ // if amplitude is valid 
@@ -163,7 +219,7 @@ void Respiration::amplitude(float value){
       amplitudes[amplitudeIndex] = _amplitude;
       amplitudeIndex = (amplitudeIndex + 1) % numberOfCycles;
 
-      if(oldestAmplitude > 0){ // if oldest amplitude is valid
+      if(oldestAmplitude > 0 && _millisPassed > 0){ // if oldest amplitude is valid (and intervals are known)
       _amplitudeRateOfChange = (_amplitude - oldestAmplitude)/_millisPassed * 60000; // calculate rate of change (signal units/minute)
      }
     _amplitudeRateOfChange >> amplitudeRateOfChangeSmoother; // smooth rate of change
@@ -171,6 +227,7 @@ void Respiration::amplitude(float value){
     _amplitudeRateOfChange = amplitudeRateOfChangeSmoother;
     
     //AMPLITUDE VARIABILITY
+    if (_features & RESPIRATION_VARIABILITY) {
     _amplitude >> normalizerForAmplitudeVariability; // pipe amplitude into a normalizer to access standard deviation and mean stats
     if(oldestAmplitude>0 && normalizerForAmplitudeVariability.mean() > 0 && normalizerForAmplitudeVariability.stdDev() > 0){ // if oldest amplitude is valid
     _amplitudeCoefficientOfVariation = (normalizerForAmplitudeVariability.stdDev() / normalizerForAmplitudeVariability.mean())*100;
@@ -178,25 +235,24 @@ void Respiration::amplitude(float value){
  } else {
     _amplitudeCoefficientOfVariation = 0;
  }
+    }
 }
   // //AMPLITUDE Level
+  if (_features & RESPIRATION_LEVEL) {
     _amplitudeLevel = _clampScaledAmplitude >> amplitudeLevelSmoother; // smooth normalized amplitude
+  }
 }
 
 // Respiration rate data processing
 void Respiration::rpm(){ 
-  // declare and initialize local variables
-    static unsigned long intervalChrono = millis(); // respiration interval chronometer (ms) 
-    static int intervalIndex = 0; // index
-    static unsigned long oldestInterval; // oldest breath interval in the array
-
-  //INTERVAL
+  //INTERVAL (measured on sample time rather than on the time samples are processed)
   if (minMaxScaledPeak){ // on every exhale peak
-    if ((millis() - intervalChrono) >= 300){ // if interval is greater than 300ms (to prevent errors due to noise)
-    _interval = millis() - intervalChrono; // calculate interval between current and previous exhale peak
+    unsigned long elapsed = (_sampleMicros - _intervalChrono) / 1000; // time since previous exhale peak (ms)
+    if (elapsed >= 300){ // if interval is greater than 300ms (to prevent errors due to noise)
+    _interval = elapsed; // interval between current and previous exhale peak
     _rpm = 60000 /_interval;  // calculate breath rate (respirations per minute)
     }
-    intervalChrono = millis(); // restart interval chronometer
+    _intervalChrono = _sampleMicros; // restart interval chronometer
   }
 
 if (_interval > 0){ // if interval is valid
@@ -225,6 +281,7 @@ if (_interval > 0){ // if interval is valid
 
 
   //RPM VARIABILITY
+  if (_features & RESPIRATION_VARIABILITY) {
   _rpm >> normalizerForRpmVariability; // pipe rpm into a normalizer to access standard deviation and mean stats
   if (oldestInterval >0 && normalizerForRpmVariability.mean() > 0 && normalizerForRpmVariability.stdDev() > 0){ // if oldest interval is valid
   _rpmCoefficientOfVariation = (normalizerForRpmVariability.stdDev() / normalizerForRpmVariability.mean())*100;
@@ -232,11 +289,104 @@ if (_interval > 0){ // if interval is valid
   } else {
     _rpmCoefficientOfVariation = 0;
   }
+  }
 }
   //RPM Level
+  if (_features & RESPIRATION_LEVEL) {
   _rpmLevel = _clampScaledRpm >> rpmLevelSmoother; // smooth normalized rpm
+  }
+}
+
+
+//==============================================STATE===============================================//
+// Saves state as a blob
+size_t Respiration::saveState(uint8_t* buffer, size_t size) const {
+  return saveStateBlob(*this, STATE_RESPIRATION, buffer, size);
 }
 
+// Restores state from a blob
+bool Respiration::loadState(const uint8_t* buffer, size_t size) {
+  return loadStateBlob(*this, STATE_RESPIRATION, buffer, size);
+}
+
+// Writes state
+void Respiration::saveState(StateWriter& out) const {
+  respMinMax.saveState(out);
+  out.write(_filteredSignal);
+  out.write((uint8_t)_exhale);
+
+  out.write(_amplitude);
+  out.write(_clampScaledAmplitude);
+  out.write(_amplitudeLevel);
+  out.write(_amplitudeRateOfChange);
+  out.write(_amplitudeCoefficientOfVariation);
+  out.write(_cycleMin);
+  out.write(_cycleMax);
+  out.write(amplitudes);
+  out.write(amplitudeIndex);
+  out.write(oldestAmplitude);
+
+  out.write((uint32_t)_interval);
+  out.write(_rpm);
+  out.write(_clampScaledRpm);
+  out.write(_rpmLevel);
+  out.write(_rpmRateOfChange);
+  out.write(_rpmCoefficientOfVariation);
+  out.write(intervals);
+  out.write(intervalIndex);
+  out.write((uint32_t)oldestInterval);
+  out.write(_millisPassed);
+}
+
+// Reads state
+bool Respiration::loadState(StateReader& in) {
+  // check size first so that the state is either fully loaded or untouched
+  StateWriter expected(NULL, 0);
+  saveState(expected);
+  if (in.getAvailable() < expected.getSize()) {
+    return false;
+  }
+
+  uint8_t exhale;
+  uint32_t interval, oldest;
+  respMinMax.loadState(in);
+  in.read(_filteredSignal);
+  in.read(exhale);
+  _exhale = exhale;
+
+  in.read(_amplitude);
+  in.read(_clampScaledAmplitude);
+  in.read(_amplitudeLevel);
+  in.read(_amplitudeRateOfChange);
+  in.read(_amplitudeCoefficientOfVariation);
+  in.read(_cycleMin);
+  in.read(_cycleMax);
+  in.read(amplitudes);
+  in.read(amplitudeIndex);
+  in.read(oldestAmplitude);
+
+  in.read(interval);
+  _interval = interval;
+  in.read(_rpm);
+  in.read(_clampScaledRpm);
+  in.read(_rpmLevel);
+  in.read(_rpmRateOfChange);
+  in.read(_rpmCoefficientOfVariation);
+  in.read(intervals);
+  in.read(intervalIndex);
+  in.read(oldest);
+  oldestInterval = oldest;
+  in.read(_millisPassed);
+
+  // keep ring buffer indices in range
+  if (amplitudeIndex < 0 || amplitudeIndex >= numberOfCycles) amplitudeIndex = 0;
+  if (intervalIndex < 0 || intervalIndex >= numberOfCycles) intervalIndex = 0;
+
+  // time bases are not saved: restart them now
+  _sampleMicros = _intervalChrono = micros();
+  resampler.reset();
+  return true;
+}
 
 //==============================================GET=================================================//
 // Returns raw signal value
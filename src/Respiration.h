@@ -31,9 +31,13 @@
 #include <Wire.h>  
 #include <numeric>
 #include "Average.h"
+#include "Events.h"
 #include "MinMax.h"
 #include "Threshold.h"
 #include "Lop.h"
+#include "Profiler.h"
+#include "Resampler.h"
+#include "State.h"
 
 #include "PlaquetteLib.h" //https://sofapirate.github.io/Plaquette/index.html
 
@@ -42,17 +46,34 @@ using namespace pq;
 #ifndef RESP_H_
 #define RESP_H_
 
+// Optional outputs of Respiration (exhale detection is always computed)
+enum RespirationFeature {
+  RESPIRATION_AMPLITUDE   = 0x01, // breath amplitude (raw, normalized, scaled, change)
+  RESPIRATION_RPM         = 0x02, // interval and respiration rate (raw, normalized, scaled, change)
+  RESPIRATION_VARIABILITY = 0x04, // coefficients of variation of enabled amplitude / rpm
+  RESPIRATION_LEVEL       = 0x08, // level indicators of enabled amplitude / rpm
+  RESPIRATION_ALL_FEATURES = 0x0F
+};
+
 class Respiration {
 
   public:   
   //==============CONSTRUCTORS==============//
-  Respiration(unsigned long rate=50);   
+  // Outputs not listed in features (see RespirationFeature) are not computed
+  // eg. Respiration(50, 0) only detects exhales
+  Respiration(unsigned long rate=50, uint8_t features=RESPIRATION_ALL_FEATURES);   
   // Constructor 
   virtual ~Respiration() {};
 
   // Metro object for sample timing
   Metro sampleMetro;
 
+  // Brings timestamped samples onto the sample rate grid
+  Resampler resampler;
+
+  // Receives exhale, inhale and breath amplitude events
+  EventEmitter events;
+
    //-----COMMON PARAMETERS-----//
         // Normalizers have a target mean of 0 and standard deviation of 1
         float normalizerMean = 0; 
@@ -132,6 +153,12 @@ class Respiration {
         // Sampling rate
         unsigned long _sampleRate;
 
+        // Enabled optional outputs (see RespirationFeature)
+        uint8_t _features;
+
+        // Time of the sample being processed (microseconds)
+        unsigned long _sampleMicros;
+
         // Raw signal
         int _signal;
         float _minMaxScaled;
@@ -148,6 +175,7 @@ class Respiration {
         float _amplitudeCoefficientOfVariation;
 
         // Rpm 
+        unsigned long _intervalChrono; // time of previous exhale peak (microseconds)
         unsigned long _interval;
         float _rpm;
         float _clampScaledRpm;
@@ -159,6 +187,31 @@ class Respiration {
         int intervals[numberOfCycles] = {};
         int _millisPassed = 0;
 
+        // Breath cycle history
+        float _cycleMin = -FLT_MIN; // base signal value at lowest point in breath cycle
+        float _cycleMax = -FLT_MIN; // base signal value at highest point in breath cycle
+        float amplitudes[numberOfCycles] = {}; // array of previous breath amplitudes
+        int amplitudeIndex = 0; // index
+        float oldestAmplitude = 0; // oldest breath amplitude in the array
+        int intervalIndex = 0; // index
+        unsigned long oldestInterval = 0; // oldest breath interval in the array
+
+#ifdef BIODATA_PROFILE
+    //-----PROFILING-----//
+        // Stages of sample() measured when BIODATA_PROFILE is defined
+        enum ProfileStage {
+          PROFILE_PEAK_OR_TROUGH, // base signal processing and peak detection
+          PROFILE_AMPLITUDE,      // amplitude data processing
+          PROFILE_RPM,            // respiration rate data processing
+          N_PROFILE_STAGES
+        };
+        typedef StageProfiler<N_PROFILE_STAGES> Profiler;
+        Profiler profiler;
+
+  const Profiler& getProfiler() const { return profiler; } // returns per-stage durations of sample()
+  void resetProfiler() { profiler.reset(); } // clears per-stage durations
+#endif
+
 //===========METHODS===========//
   // Initializes Plaquette objects and variables
   void initialize(unsigned long rate=50);
@@ -166,14 +219,49 @@ class Respiration {
   // Sets sample rate.
   void setSampleRate(unsigned long rate=50);
 
+  // Sets which optional outputs are computed (see RespirationFeature)
+  void setFeatures(uint8_t features);
+
+  // Sends EVENT_EXHALE / EVENT_INHALE to handler when exhaling starts / stops (value = scaled signal)
+  // and EVENT_BREATH_AMPLITUDE on every exhale peak with a valid amplitude (NULL to disable)
+  void setEventHandler(BioEventHandler handler, void* context=NULL);
+
   // Calls sample() at sampling rate
   void update(float signal = 0);
 
+  // Same as update(signal) for a sample taken at timestampMicros (eg. a hardware timestamp):
+  // samples are interpolated onto the sample rate grid so that bursts do not distort intervals
+  void update(float signal, unsigned long timestampMicros);
+
+  // Calls update(signal, timestampMicros) on n timestamped samples
+  void updateBlock(const float* signals, const unsigned long* timestampsMicros, size_t n);
+
   void sample(float signal = 0);   // reads the signal and passes it to the signal processing functions
+  void sample(float signal, unsigned long timestampMicros); // same for a sample taken at timestampMicros
   void peakOrTrough(float value); // base signal processing and peak detection
   void amplitude(float value); // amplitude data processing
   void rpm(); // respiration rate data processing
 
+  // Saves state (peak detection, breath cycle history, amplitude and rpm values) into buffer
+  // returns the size of the state: if larger than size, nothing usable was written
+  //
+  // Resuming is partial: Plaquette does not expose the state of its objects, so
+  // the normalizers (normalizer, amplitudeNormalizer, rpmNormalizer and the two
+  // variability normalizers), the smoothers, minMaxScaler and the peak detectors
+  // are not saved and start over after loadState(). Until they settle again
+  // (normalizerTimeWindow for the signal, amplitudeNormalizerTimeWindow and
+  // rpmNormalizerTimeWindow for the features), peak detection and the scaled,
+  // level and variability outputs behave as after initialize(). What carries
+  // over is the breath cycle history, the breathing phase and the last outputs.
+  size_t saveState(uint8_t* buffer, size_t size) const;
+
+  // Restores state saved by saveState() ; returns false and keeps current state if data is invalid
+  bool loadState(const uint8_t* buffer, size_t size);
+
+  // Writes / reads state without header (eg. to embed it in a larger snapshot)
+  void saveState(StateWriter& out) const;
+  bool loadState(StateReader& in);
+
   // Returns raw signal.
   int32_t getRaw() const;
 
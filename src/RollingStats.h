@@ -0,0 +1,125 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Rolling statistics over a whole recorded signal in one pass, for offline
+ * analysis. output[i] is the statistic of input[i - window + 1 .. i] (of
+ * input[0 .. i] for the first window - 1 samples), ie. the value an
+ * Average(window) would give after pushing input[0 .. i].
+ *
+ *   rollingMean(signal, n, 200, mean);
+ *   rollingMaximum(signal, n, 200, maximum, scratch); // scratch: n values
+ *
+ * Mean and standard deviation use running sums (O(1) per sample, whatever
+ * the window), updated with compensated additions (see CompensatedSum.h)
+ * so that they do not drift over long recordings. Minimum and maximum use
+ * the van Herk / Gil-Werman algorithm: three comparisons per sample,
+ * whatever the window.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROLLING_STATS_H_
+#define ROLLING_STATS_H_
+
+#include <math.h>
+#include <stddef.h>
+
+#include "CompensatedSum.h"
+
+/// Rolling mean of n samples of input into output.
+template <class T>
+void rollingMean(const T* input, size_t n, size_t window, float* output) {
+  if (window == 0) window = 1;
+  double sum = 0, sumCompensation = 0;
+  for (size_t i = 0; i < n; i++) {
+    compensatedAdd(sum, sumCompensation, (double)input[i]);
+    if (i >= window)
+      compensatedAdd(sum, sumCompensation, -(double)input[i - window]);
+    output[i] = (float)((sum + sumCompensation) / (i < window ? i + 1 : window));
+  }
+}
+
+/// Rolling (population) standard deviation of n samples of input into output.
+template <class T>
+void rollingStddev(const T* input, size_t n, size_t window, float* output) {
+  if (window == 0) window = 1;
+  if (n == 0) return;
+  // Sums of samples offset by the first one, to limit cancellation.
+  double offset = input[0];
+  double sum = 0, sumCompensation = 0;
+  double sumSquares = 0, sumSquaresCompensation = 0;
+  for (size_t i = 0; i < n; i++) {
+    double x = input[i] - offset;
+    compensatedAdd(sum, sumCompensation, x);
+    compensatedAdd(sumSquares, sumSquaresCompensation, x * x);
+    if (i >= window) {
+      double old = input[i - window] - offset;
+      compensatedAdd(sum, sumCompensation, -old);
+      compensatedAdd(sumSquares, sumSquaresCompensation, -old * old);
+    }
+    double count = (double)(i < window ? i + 1 : window);
+    double total = sum + sumCompensation;
+    double variance = (sumSquares + sumSquaresCompensation - total * total / count) / count;
+    output[i] = variance > 0 ? (float)sqrt(variance) : 0;
+  }
+}
+
+// van Herk / Gil-Werman: with the signal cut into blocks of window samples,
+// the window ending at i is covered by the end of one block (suffix) and the
+// start of the next (prefix). Prefixes are computed into output, suffixes into
+// scratch. Compare(a, b) returns true if a should be kept over b.
+template <class T, class Compare>
+void rollingExtremum(const T* input, size_t n, size_t window, T* output, T* scratch, Compare compare) {
+  if (window == 0) window = 1;
+  if (n == 0) return;
+
+  for (size_t i = 0; i < n; i++)
+    output[i] = (i % window == 0 || compare(input[i], output[i - 1])) ? input[i] : output[i - 1];
+
+  scratch[n - 1] = input[n - 1];
+  for (size_t i = n - 1; i-- > 0; )
+    scratch[i] = ((i + 1) % window == 0 || compare(input[i], scratch[i + 1])) ? input[i] : scratch[i + 1];
+
+  // The first window - 1 outputs are prefixes of the first block already.
+  for (size_t i = window - 1; i < n; i++) {
+    const T& suffix = scratch[i + 1 - window];
+    if (compare(suffix, output[i]))
+      output[i] = suffix;
+  }
+}
+
+template <class T>
+struct RollingLess {
+  bool operator()(const T& a, const T& b) const { return a < b; }
+};
+
+template <class T>
+struct RollingGreater {
+  bool operator()(const T& a, const T& b) const { return b < a; }
+};
+
+/// Rolling minimum of n samples of input into output. scratch holds n values.
+template <class T>
+void rollingMinimum(const T* input, size_t n, size_t window, T* output, T* scratch) {
+  rollingExtremum(input, n, window, output, scratch, RollingLess<T>());
+}
+
+/// Rolling maximum of n samples of input into output. scratch holds n values.
+template <class T>
+void rollingMaximum(const T* input, size_t n, size_t window, T* output, T* scratch) {
+  rollingExtremum(input, n, window, output, scratch, RollingGreater<T>());
+}
+
+#endif
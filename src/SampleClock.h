@@ -0,0 +1,135 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Decides when a sensor is due for a new sample and keeps track of missed
+ * sample periods, so that a sensor polled too slowly (eg. on a loaded
+ * gateway) reports it instead of silently drifting to a lower rate.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAMPLE_CLOCK_H_
+#define SAMPLE_CLOCK_H_
+
+class SampleClock {
+
+  // Sample period.
+  unsigned long period;
+
+  // Time of last processed sample.
+  unsigned long prevMicros;
+
+  // Time of reset.
+  unsigned long startMicros;
+
+  // Statistics.
+  unsigned long nSamples;
+  unsigned long nMissed;
+  unsigned long worstLateness;
+
+  // Maximum number of samples processed per tick.
+  unsigned int maxCatchUp;
+
+public:
+  /// Constructor.
+  SampleClock(unsigned long periodMicros=5000) : maxCatchUp(1) {
+    setPeriod(periodMicros);
+    reset(0);
+  }
+
+  /// Restarts the clock and clears statistics.
+  void reset(unsigned long nowMicros) {
+    prevMicros = startMicros = nowMicros;
+    nSamples = nMissed = worstLateness = 0;
+  }
+
+  /// Sets sample period in microseconds.
+  void setPeriod(unsigned long periodMicros) {
+    period = periodMicros > 0 ? periodMicros : 1;
+  }
+
+  /// Returns sample period in microseconds.
+  unsigned long getPeriod() const {
+    return period;
+  }
+
+  /**
+   * Sets maximum number of samples to process at a late tick. With the
+   * default of 1, a late tick processes a single sample and the elapsed
+   * periods are counted as missed. With more, the clock stays locked on the
+   * sample rate grid and elapsed periods are processed, up to maxSamples.
+   */
+  void setCatchUp(unsigned int maxSamples) {
+    maxCatchUp = maxSamples > 0 ? maxSamples : 1;
+  }
+
+  /// Returns time of last processed sample (microseconds).
+  unsigned long getLastMicros() const {
+    return prevMicros;
+  }
+
+  /**
+   * Checks the clock at nowMicros. Returns how many samples should be
+   * processed (0 if not due yet), which is at most 1 unless catch-up is on.
+   */
+  unsigned long tick(unsigned long nowMicros) {
+    unsigned long elapsed = nowMicros - prevMicros;
+    if (elapsed < period)
+      return 0;
+
+    unsigned long periods = elapsed / period;
+    unsigned long lateness = elapsed - period;
+    if (lateness > worstLateness)
+      worstLateness = lateness;
+
+    unsigned long n;
+    if (maxCatchUp > 1) {
+      // Stay on the grid.
+      n = periods < maxCatchUp ? periods : maxCatchUp;
+      prevMicros += periods * period;
+    }
+    else {
+      n = 1;
+      prevMicros = nowMicros;
+    }
+
+    nMissed += periods - n;
+    nSamples += n;
+    return n;
+  }
+
+  /// Returns number of processed samples since reset.
+  unsigned long getSampleCount() const {
+    return nSamples;
+  }
+
+  /// Returns number of sample periods that were skipped since reset.
+  unsigned long getMissedCount() const {
+    return nMissed;
+  }
+
+  /// Returns worst delay of a tick past its due time since reset (microseconds).
+  unsigned long getWorstLateness() const {
+    return worstLateness;
+  }
+
+  /// Returns average rate at which samples were processed since reset (Hz).
+  float getEffectiveRate() const {
+    unsigned long duration = prevMicros - startMicros;
+    return duration ? nSamples * 1000000.0f / duration : 0;
+  }
+};
+
+#endif
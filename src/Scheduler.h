@@ -0,0 +1,206 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Drives several sensors at their own sample rates from a single time base.
+ *
+ * The scheduler runs at a base tick rate. Each task runs once every
+ * divider = tickRate / rate ticks, in registration order, at a phase
+ * chosen when it is added so that tasks share as few ticks as possible.
+ * With a 1 kHz tick, a 200 Hz Heart and two 50 Hz sensors never run on
+ * the same tick.
+ *
+ *   Scheduler<3> scheduler(1000);
+ *   void sampleHeart(unsigned long t, void*) { heart.sample(analogRead(A1), t); }
+ *   ...
+ *   scheduler.add(sampleHeart, NULL, 200);
+ *   ...
+ *   scheduler.update(micros()); // in loop(), or scheduler.tick() from a timer / ADC interrupt
+ *
+ * Tasks receive the time of their tick, so sensors see a regular sample grid
+ * even when update() runs late and catches up on several ticks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SampleClock.h"
+
+/// Scheduled task: receives the time of the tick (microseconds) and its context.
+typedef void (*SchedulerCallback)(unsigned long timestampMicros, void* context);
+
+template <uint8_t MAX_TASKS>
+class Scheduler {
+  struct Task {
+    SchedulerCallback callback;
+    void* context;
+    uint16_t divider;   // runs once every divider ticks
+    uint16_t phase;     // tick offset within the divider, counted from reset()
+    uint16_t countdown; // ticks until next run
+  };
+
+  Task tasks[MAX_TASKS];
+  uint8_t nTasks;
+
+  unsigned long tickRate;
+
+  // Converts time into ticks for update().
+  SampleClock clock;
+
+  // Time of the current tick.
+  unsigned long tickMicros;
+
+  // Ticks processed since reset(), to place tasks added later on their phase
+  // (tasks added after it wraps, 50 days at 1 kHz with 32 bits, may collide).
+  unsigned long elapsedTicks;
+
+public:
+  /// Default maximum number of ticks processed by a single update().
+  static const unsigned int DEFAULT_CATCH_UP = 256;
+
+  /// Constructor. Tick rate in Hz (eg. 1000, or the rate of an ADC interrupt).
+  Scheduler(unsigned long tickRate_=1000) : nTasks(0) {
+    tickRate = tickRate_ > 0 ? tickRate_ : 1;
+    clock.setPeriod(1000000UL / tickRate);
+    clock.setCatchUp(DEFAULT_CATCH_UP);
+    reset(0);
+  }
+
+  /// Restarts the time base at nowMicros; all tasks restart at their phase.
+  void reset(unsigned long nowMicros) {
+    clock.reset(nowMicros);
+    tickMicros = nowMicros;
+    elapsedTicks = 0;
+    for (uint8_t i = 0; i < nTasks; i++)
+      tasks[i].countdown = tasks[i].phase;
+  }
+
+  /**
+   * Adds a task running at rate (Hz), which is rounded to tickRate / divider
+   * with an integer divider: set the sensor to getRate(task). Returns the
+   * task index, or -1 if there is no room left.
+   */
+  int8_t add(SchedulerCallback callback, void* context, unsigned long rate) {
+    if (nTasks >= MAX_TASKS || !callback)
+      return -1;
+
+    unsigned long divider = rate > 0 ? (tickRate + rate / 2) / rate : tickRate;
+    if (divider < 1) divider = 1;
+    if (divider > 0xFFFF) divider = 0xFFFF;
+
+    Task& task = tasks[nTasks];
+    task.callback = callback;
+    task.context = context;
+    task.divider = divider;
+    task.phase = bestPhase(divider);
+    task.countdown = (task.phase + divider - elapsedTicks % divider) % divider;
+    return nTasks++;
+  }
+
+  /// Returns number of tasks.
+  uint8_t getTaskCount() const {
+    return nTasks;
+  }
+
+  /// Returns actual rate of a task (Hz).
+  float getRate(uint8_t task) const {
+    return (float)tickRate / tasks[task].divider;
+  }
+
+  /// Returns tick offset of a task within its period.
+  uint16_t getPhase(uint8_t task) const {
+    return tasks[task].phase;
+  }
+
+  /// Sets maximum number of ticks processed by a single update() (others are counted as missed).
+  void setCatchUp(unsigned int maxTicks) {
+    clock.setCatchUp(maxTicks);
+  }
+
+  /// Returns number of ticks skipped by update().
+  unsigned long getMissedTicks() const {
+    return clock.getMissedCount();
+  }
+
+  /**
+   * Processes all ticks due at nowMicros (eg. micros()). Call it at least
+   * as often as the fastest task.
+   */
+  void update(unsigned long nowMicros) {
+    unsigned long n = clock.tick(nowMicros);
+    if (n == 0)
+      return;
+    unsigned long t = clock.getLastMicros() - (n - 1) * clock.getPeriod();
+    for (unsigned long k = 0; k < n; k++, t += clock.getPeriod())
+      tick(t);
+  }
+
+  /// Advances by one tick (eg. from a timer or ADC interrupt).
+  void tick() {
+    tick(tickMicros + clock.getPeriod());
+  }
+
+  /// Advances by one tick taking place at timestampMicros.
+  void tick(unsigned long timestampMicros) {
+    tickMicros = timestampMicros;
+    elapsedTicks++;
+    for (uint8_t i = 0; i < nTasks; i++) {
+      Task& task = tasks[i];
+      if (task.countdown == 0) {
+        task.countdown = task.divider;
+        task.callback(timestampMicros, task.context);
+      }
+      task.countdown--;
+    }
+  }
+
+private:
+  static unsigned long gcd(unsigned long a, unsigned long b) {
+    while (b) {
+      unsigned long r = a % b;
+      a = b;
+      b = r;
+    }
+    return a;
+  }
+
+  // Picks the phase in [0, divider) that shares ticks with the fewest
+  // existing tasks. Two tasks meet on some tick iff their phases are
+  // congruent modulo the gcd of their dividers. Phases rather than
+  // countdowns are compared so that the choice still holds after reset().
+  uint16_t bestPhase(unsigned long divider) const {
+    uint16_t best = 0;
+    uint8_t bestCollisions = 0xFF;
+    for (unsigned long phase = 0; phase < divider && bestCollisions > 0; phase++) {
+      uint8_t collisions = 0;
+      for (uint8_t i = 0; i < nTasks; i++) {
+        unsigned long g = gcd(divider, tasks[i].divider);
+        if (phase % g == tasks[i].phase % g)
+          collisions++;
+      }
+      if (collisions < bestCollisions) {
+        best = phase;
+        bestCollisions = collisions;
+      }
+    }
+    return best;
+  }
+};
+
+#endif
@@ -0,0 +1,313 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Shared-memory ring of feature frames and events, for local processes
+ * (visualizers, sound engines...) that need every frame with minimal
+ * latency. Host computers only (POSIX shm_open() + mmap()).
+ *
+ * One process writes, any number of processes read. Readers never block
+ * the writer: each slot is protected by a sequence number (seqlock), and a
+ * reader that falls more than a ring behind skips ahead and counts the
+ * records it lost.
+ *
+ *   // Writer
+ *   SharedMemoryRing ring;
+ *   ring.create("/biodata", 1024);
+ *   ring.writeFrame(frame);
+ *
+ *   // Reader (other process)
+ *   SharedMemoryRing ring;
+ *   ring.open("/biodata");
+ *   uint8_t type; uint8_t data[SharedMemoryRing::DEFAULT_PAYLOAD_SIZE];
+ *   while (ring.read(type, data, sizeof(data)) >= 0)
+ *     if (type == SHM_RECORD_FRAME) { FeatureFrame frame; memcpy(&frame, data, sizeof(frame)); ... }
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARED_MEMORY_RING_H_
+#define SHARED_MEMORY_RING_H_
+
+#if !defined(ARDUINO) && (defined(__unix__) || defined(__APPLE__))
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Events.h"
+#include "FeatureFrame.h"
+
+/// Types of records in the ring.
+enum SharedMemoryRecordType {
+  SHM_RECORD_FRAME = 1, // FeatureFrame
+  SHM_RECORD_EVENT = 2  // BioEvent (source pointer is only meaningful in the writer)
+};
+
+class SharedMemoryRing {
+public:
+  /// Default maximum record size.
+  static const uint32_t DEFAULT_PAYLOAD_SIZE = 128;
+
+private:
+  static const uint32_t MAGIC = 0x42445352UL; // "BDSR"
+  static const uint32_t VERSION = 1;
+
+  // Start of the shared memory.
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;    // number of slots
+    uint32_t payloadSize; // maximum record size
+    uint32_t slotSize;    // bytes per slot
+    uint32_t reserved;
+    std::atomic<uint64_t> head; // number of records written
+  };
+
+  // Start of each slot, followed by the payload.
+  struct Slot {
+    // 2 * (record number + 1) once written, odd while being written.
+    std::atomic<uint64_t> sequence;
+    uint32_t type;
+    uint32_t size;
+  };
+
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+                "shared memory needs lock-free 64-bit atomics");
+
+  Header* header;
+  uint8_t* slots;
+  size_t mappedSize;
+  bool writer;
+
+  // Reader: next record number to read, and number of records lost.
+  uint64_t next;
+  uint64_t lost;
+
+public:
+  SharedMemoryRing() : header(NULL), slots(NULL), mappedSize(0), writer(false), next(0), lost(0) {}
+  ~SharedMemoryRing() { close(); }
+
+  SharedMemoryRing(const SharedMemoryRing&) = delete;
+  SharedMemoryRing& operator=(const SharedMemoryRing&) = delete;
+
+  /**
+   * Creates (or replaces) the ring called name (eg. "/biodata") with room
+   * for capacity records of up to payloadSize bytes, and opens it for
+   * writing. Returns false on error.
+   *
+   * An existing ring is unlinked rather than reused, so that readers still
+   * mapping it are not truncated under their feet: they keep the old ring
+   * (freed when they close it) and must open() again to follow the new one.
+   */
+  bool create(const char* name, uint32_t capacity, uint32_t payloadSize=DEFAULT_PAYLOAD_SIZE) {
+    close();
+    if (capacity == 0)
+      return false;
+
+    uint32_t slotSize = (sizeof(Slot) + payloadSize + 7) & ~7U;
+    size_t size = sizeof(Header) + (size_t)capacity * slotSize;
+
+    // O_EXCL: fails rather than share the ring if another writer recreated
+    // it in between.
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+      return false;
+    bool ok = (ftruncate(fd, size) == 0) && map(fd, size, PROT_READ | PROT_WRITE);
+    ::close(fd);
+    if (!ok)
+      return false;
+
+    // Readers check the magic number last.
+    header->magic = 0;
+    header->version = VERSION;
+    header->capacity = capacity;
+    header->payloadSize = payloadSize;
+    header->slotSize = slotSize;
+    header->reserved = 0;
+    header->head.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < capacity; i++)
+      slot(i)->sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = MAGIC;
+
+    writer = true;
+    return true;
+  }
+
+  /**
+   * Opens the ring called name for reading. Reading starts with the next
+   * record written. Returns false if the ring does not exist or is invalid.
+   */
+  bool open(const char* name) {
+    close();
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    bool ok = (fstat(fd, &st) == 0) && (size_t)st.st_size >= sizeof(Header) && map(fd, st.st_size, PROT_READ);
+    ::close(fd);
+    if (!ok)
+      return false;
+
+    if (header->magic != MAGIC || header->version != VERSION || header->capacity == 0 ||
+        sizeof(Header) + (size_t)header->capacity * header->slotSize > mappedSize) {
+      close();
+      return false;
+    }
+
+    writer = false;
+    next = header->head.load(std::memory_order_acquire);
+    lost = 0;
+    return true;
+  }
+
+  /// Unmaps the ring (the shared memory stays until unlink()).
+  void close() {
+    if (header)
+      munmap(header, mappedSize);
+    header = NULL;
+    slots = NULL;
+    mappedSize = 0;
+  }
+
+  /// Removes the ring called name once all processes have closed it.
+  static bool unlink(const char* name) {
+    return shm_unlink(name) == 0;
+  }
+
+  /// Returns true if the ring is open.
+  bool isOpen() const {
+    return header != NULL;
+  }
+
+  /// Writes a record. Returns false if not open for writing or if size is too large.
+  bool write(uint8_t type, const void* data, size_t size) {
+    if (!writer || size > header->payloadSize)
+      return false;
+
+    uint64_t n = header->head.load(std::memory_order_relaxed);
+    Slot* s = slot(n % header->capacity);
+
+    s->sequence.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s->type = type;
+    s->size = size;
+    memcpy(payload(s), data, size);
+    s->sequence.store(2 * n + 2, std::memory_order_release);
+
+    header->head.store(n + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Writes a feature frame.
+  bool writeFrame(const FeatureFrame& frame) {
+    return write(SHM_RECORD_FRAME, &frame, sizeof(frame));
+  }
+
+  /// Writes an event.
+  bool writeEvent(const BioEvent& event) {
+    return write(SHM_RECORD_EVENT, &event, sizeof(event));
+  }
+
+  /**
+   * Reads the next record into data (at most size bytes) and its type into
+   * type. Returns the size of the record, or -1 if there is none.
+   */
+  int read(uint8_t& type, void* data, size_t size) {
+    if (!header)
+      return -1;
+
+    for (;;) {
+      uint64_t head = header->head.load(std::memory_order_acquire);
+      if (next == head)
+        return -1;
+
+      // Overrun: the records we have not read yet were overwritten.
+      if (head - next > header->capacity) {
+        lost += head - header->capacity - next;
+        next = head - header->capacity;
+      }
+
+      const Slot* s = slot(next % header->capacity);
+      uint64_t expected = 2 * next + 2;
+      uint64_t before = s->sequence.load(std::memory_order_acquire);
+      if (before != expected) {
+        // Already being rewritten for a later record.
+        lost++;
+        next++;
+        continue;
+      }
+
+      uint32_t recordType = s->type;
+      uint32_t recordSize = s->size;
+      if (recordSize > header->payloadSize)
+        recordSize = header->payloadSize;
+      memcpy(data, payload(s), recordSize < size ? recordSize : size);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (s->sequence.load(std::memory_order_relaxed) != expected) {
+        // Overwritten while copying.
+        lost++;
+        next++;
+        continue;
+      }
+
+      next++;
+      type = recordType;
+      return recordSize;
+    }
+  }
+
+  /// Returns number of records the reader missed because it fell behind.
+  uint64_t getLost() const {
+    return lost;
+  }
+
+  /// Returns number of records written to the ring so far.
+  uint64_t getWritten() const {
+    return header ? header->head.load(std::memory_order_acquire) : 0;
+  }
+
+private:
+  bool map(int fd, size_t size, int protection) {
+    void* memory = mmap(NULL, size, protection, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED)
+      return false;
+    header = static_cast<Header*>(memory);
+    slots = static_cast<uint8_t*>(memory) + sizeof(Header);
+    mappedSize = size;
+    return true;
+  }
+
+  Slot* slot(uint64_t index) const {
+    return reinterpret_cast<Slot*>(slots + index * header->slotSize);
+  }
+
+  static uint8_t* payload(const Slot* s) {
+    return (uint8_t*)s + sizeof(Slot);
+  }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,494 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Deterministic synthetic sensor signals, for testing and benchmarking the
+ * sensors without a subject: the same seed always gives the same samples.
+ *
+ *   PulseGenerator ppg(200, 1234);    // Heart input at 200 Hz
+ *   for (...) {
+ *     heart.sample(ppg.next(), ppg.getMicros());
+ *     if (ppg.beatOccurred()) ...      // ground truth
+ *   }
+ *
+ * - PulseGenerator: photoplethysmograph with variable heart rate (slow drift,
+ *   respiratory sinus arrhythmia and beat-to-beat variability), dicrotic
+ *   notch, amplitude drift, baseline wander and noise.
+ * - SkinConductanceGenerator: tonic level drifting around a mean, with skin
+ *   conductance responses at random times. As with the BioData circuit, the
+ *   signal goes down when conductance goes up.
+ * - RespirationGenerator: thermistor placed under the nose (warms up while
+ *   exhaling) with variable rate and depth.
+ *
+ * Outputs are in ADC units in [0, fullScale] (1023 by default) and rounded
+ * to integers like analogRead() values.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIGNAL_GENERATOR_H_
+#define SIGNAL_GENERATOR_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#include "ConstMath.h"
+
+/// Small seedable pseudo-random number generator (xorshift32).
+class SignalRandom {
+  uint32_t state;
+  float spare;
+  bool hasSpare;
+
+public:
+  /// Constructor.
+  SignalRandom(uint32_t seed=1) {
+    setSeed(seed);
+  }
+
+  /// Restarts the sequence.
+  void setSeed(uint32_t seed) {
+    // Scrambles the seed so that close seeds give unrelated sequences.
+    seed = (seed ^ 0x5DEECE66UL) * 0x9E3779B1UL;
+    seed ^= seed >> 16;
+    state = seed ? seed : 0x6D2B79F5UL;
+    hasSpare = false;
+  }
+
+  /// Returns a uniformly distributed 32-bit integer.
+  uint32_t next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+
+  /// Returns a uniformly distributed value in [0, 1).
+  float uniform() {
+    return (next() >> 8) * (1.0f / 16777216.0f);
+  }
+
+  /// Returns a normally distributed value (mean 0, standard deviation 1).
+  float gaussian() {
+    if (hasSpare) {
+      hasSpare = false;
+      return spare;
+    }
+    // Box-Muller transform.
+    float u = 1.0f - uniform(); // in (0, 1]
+    float r = sqrtf(-2.0f * logf(u));
+    float theta = 2.0f * float(ConstMath::pi) * uniform();
+    spare = r * sinf(theta);
+    hasSpare = true;
+    return r * cosf(theta);
+  }
+};
+
+/// Base of the generators: sample rate, time and random sources.
+class SignalGenerator {
+protected:
+  unsigned long sampleRate;
+  float dt; // sample period (seconds)
+  uint32_t count;
+
+  SignalRandom random;
+
+  float fullScale;
+  float noise;
+
+  SignalGenerator(unsigned long rate, uint32_t seed) : random(seed) {
+    sampleRate = rate > 0 ? rate : 1;
+    dt = 1.0f / sampleRate;
+    count = 0;
+    fullScale = 1023;
+    noise = 0;
+  }
+
+  // Random walk pulled back towards 0 (Ornstein-Uhlenbeck process) with the
+  // given time constant (s) and long-term standard deviation.
+  float wander(float value, float timeConstant, float deviation) {
+    float pull = dt / timeConstant;
+    return value - pull * value + deviation * sqrtf(2.0f * pull) * random.gaussian();
+  }
+
+  // Adds noise, clamps to the ADC range and rounds.
+  float output(float value) {
+    value += noise * random.gaussian();
+    if (value < 0) value = 0;
+    else if (value > fullScale) value = fullScale;
+    count++;
+    return floorf(value + 0.5f);
+  }
+
+public:
+  /// Restarts the signal from the beginning with the given seed.
+  void restart(uint32_t seed) {
+    random.setSeed(seed);
+    count = 0;
+  }
+
+  /// Sets maximum ADC value (eg. 4095 for 12 bits).
+  void setFullScale(float value) {
+    fullScale = value;
+  }
+
+  /// Sets standard deviation of the measurement noise (ADC units).
+  void setNoise(float deviation) {
+    noise = deviation;
+  }
+
+  /// Returns sample rate (Hz).
+  unsigned long getSampleRate() const {
+    return sampleRate;
+  }
+
+  /// Returns number of samples generated.
+  uint32_t getCount() const {
+    return count;
+  }
+
+  /// Returns time of the last sample (microseconds, starting at 0).
+  unsigned long getMicros() const {
+    return count > 0 ? (unsigned long)((uint64_t)(count - 1) * 1000000UL / sampleRate) : 0;
+  }
+};
+
+/// Photoplethysmograph (Heart input).
+class PulseGenerator : public SignalGenerator {
+  // Heart rate.
+  float meanBpm;
+  float bpmDrift;       // standard deviation of the slow drift (BPM)
+  float beatVariability; // standard deviation of beat-to-beat intervals (s)
+  float arrhythmia;     // respiratory sinus arrhythmia depth (BPM)
+  float breathRate;     // Hz
+
+  // Amplitude and baseline (ADC units).
+  float amplitude;
+  float amplitudeDrift; // relative standard deviation
+  float baseline;
+  float baselineWander;
+
+  // State.
+  float phase;          // position in current beat [0, 1)
+  float interval;       // current beat interval (s)
+  float drift;
+  float amplitudeFactor;
+  float breathPhase;
+  bool beat;
+
+public:
+  /// Constructor.
+  PulseGenerator(unsigned long rate=200, uint32_t seed=1) : SignalGenerator(rate, seed) {
+    setHeartRate(72, 4, 0.03f);
+    setArrhythmia(3, 0.25f);
+    setAmplitude(200, 0.1f);
+    setBaseline(512, 20);
+    setNoise(3);
+    restart(seed);
+  }
+
+  /**
+   * Sets mean heart rate (BPM), standard deviation of its slow drift (BPM)
+   * and standard deviation of beat-to-beat intervals (seconds).
+   */
+  void setHeartRate(float bpm, float drift_=0, float variability=0) {
+    meanBpm = bpm;
+    bpmDrift = drift_;
+    beatVariability = variability;
+  }
+
+  /// Sets depth (BPM) and rate (Hz) of the heart rate modulation by breathing.
+  void setArrhythmia(float depth, float rate=0.25f) {
+    arrhythmia = depth;
+    breathRate = rate;
+  }
+
+  /// Sets pulse amplitude (ADC units) and relative standard deviation of its drift.
+  void setAmplitude(float amplitude_, float drift_=0) {
+    amplitude = amplitude_;
+    amplitudeDrift = drift_;
+  }
+
+  /// Sets baseline level and amplitude of its wander with breathing (ADC units).
+  void setBaseline(float level, float wander_=0) {
+    baseline = level;
+    baselineWander = wander_;
+  }
+
+  /// Restarts the signal from the beginning with the given seed.
+  void restart(uint32_t seed) {
+    SignalGenerator::restart(seed);
+    phase = 0;
+    drift = 0;
+    amplitudeFactor = 1;
+    breathPhase = 0;
+    beat = false;
+    interval = nextInterval();
+  }
+
+  /// Returns next sample.
+  float next() {
+    drift = wander(drift, 30, bpmDrift);
+    amplitudeFactor = 1 + wander(amplitudeFactor - 1, 20, amplitudeDrift);
+    breathPhase += breathRate * dt;
+    if (breathPhase >= 1) breathPhase -= 1;
+
+    beat = false;
+    phase += dt / interval;
+    if (phase >= 1) {
+      phase -= 1;
+      interval = nextInterval();
+      beat = true;
+    }
+
+    // Steep systolic upstroke, slower decay and a smaller diastolic wave
+    // after the dicrotic notch.
+    float systole = (phase - 0.15f) / (phase < 0.15f ? 0.05f : 0.12f);
+    float diastole = (phase - 0.38f) / 0.1f;
+    float pulse = expf(-systole * systole) + 0.3f * expf(-diastole * diastole);
+
+    float breath = sinf(2.0f * float(ConstMath::pi) * breathPhase);
+    return output(baseline + baselineWander * breath + amplitude * amplitudeFactor * (pulse - 0.3f));
+  }
+
+  /// Returns true if a beat started at the last sample.
+  bool beatOccurred() const {
+    return beat;
+  }
+
+  /// Returns interval of the current beat (milliseconds).
+  float getInterval() const {
+    return interval * 1000;
+  }
+
+  /// Returns heart rate of the current beat (BPM).
+  float getBPM() const {
+    return 60 / interval;
+  }
+
+private:
+  float nextInterval() {
+    float bpm = meanBpm + drift + arrhythmia * sinf(2.0f * float(ConstMath::pi) * breathPhase);
+    if (bpm < 30) bpm = 30;
+    else if (bpm > 200) bpm = 200;
+    float seconds = 60 / bpm + beatVariability * random.gaussian();
+    return seconds > 0.25f ? seconds : 0.25f;
+  }
+};
+
+/// Skin conductance (SkinConductance input).
+class SkinConductanceGenerator : public SignalGenerator {
+  // Tonic level (ADC units).
+  float level;
+  float levelDrift;
+
+  // Responses.
+  float responseRate;      // per second
+  float responseAmplitude; // mean peak (ADC units)
+  float riseDecay;         // per-sample decay of the rising exponential
+  float fallDecay;         // per-sample decay of the falling exponential
+  float responseScale;     // normalizes peak of the bi-exponential to 1
+
+  // State.
+  float drift;
+  float rising;
+  float falling;
+  bool response;
+
+public:
+  /// Constructor.
+  SkinConductanceGenerator(unsigned long rate=50, uint32_t seed=1) : SignalGenerator(rate, seed) {
+    setLevel(600, 40);
+    setResponses(4, 60);
+    setResponseShape(0.75f, 3);
+    setNoise(1);
+    restart(seed);
+  }
+
+  /// Sets mean tonic level and standard deviation of its drift (ADC units).
+  void setLevel(float level_, float drift_=0) {
+    level = level_;
+    levelDrift = drift_;
+  }
+
+  /// Sets mean number of responses per minute and their mean amplitude (ADC units).
+  void setResponses(float perMinute, float amplitude) {
+    responseRate = perMinute / 60;
+    responseAmplitude = amplitude;
+  }
+
+  /// Sets rise and recovery time constants of the responses (seconds).
+  void setResponseShape(float rise, float recovery) {
+    if (rise >= recovery) rise = recovery / 2;
+    riseDecay = expf(-dt / rise);
+    fallDecay = expf(-dt / recovery);
+    // Peak of exp(-t/recovery) - exp(-t/rise).
+    float peakTime = logf(recovery / rise) * rise * recovery / (recovery - rise);
+    responseScale = 1 / (expf(-peakTime / recovery) - expf(-peakTime / rise));
+  }
+
+  /// Restarts the signal from the beginning with the given seed.
+  void restart(uint32_t seed) {
+    SignalGenerator::restart(seed);
+    drift = rising = falling = 0;
+    response = false;
+  }
+
+  /// Returns next sample.
+  float next() {
+    drift = wander(drift, 60, levelDrift);
+
+    response = random.uniform() < responseRate * dt;
+    if (response) {
+      float peak = responseAmplitude * (0.5f + random.uniform());
+      rising += peak;
+      falling += peak;
+    }
+    rising *= riseDecay;
+    falling *= fallDecay;
+
+    return output(level + drift - responseScale * (falling - rising));
+  }
+
+  /// Returns true if a response started at the last sample.
+  bool responseOccurred() const {
+    return response;
+  }
+};
+
+/// Thermistor respiration sensor (Respiration input).
+class RespirationGenerator : public SignalGenerator {
+  float meanRpm;
+  float rpmDrift;
+  float breathVariability; // relative standard deviation of breath durations
+  float depth;             // ADC units
+  float depthVariability;  // relative standard deviation
+  float baseline;
+  float exhaleRatio;       // fraction of the cycle spent exhaling
+  float thermalSmoothing;  // per-sample smoothing of the thermistor
+
+  // State.
+  float phase;
+  float duration;          // current breath (s)
+  float breathDepth;
+  float drift;
+  float temperature;
+  bool breath;
+
+public:
+  /// Constructor.
+  RespirationGenerator(unsigned long rate=50, uint32_t seed=1) : SignalGenerator(rate, seed) {
+    setRate(14, 2, 0.1f);
+    setDepth(150, 0.15f);
+    setBaseline(400);
+    setExhaleRatio(0.6f);
+    setThermalTimeConstant(0.3f);
+    setNoise(2);
+    restart(seed);
+  }
+
+  /**
+   * Sets mean respiration rate (per minute), standard deviation of its slow
+   * drift and relative standard deviation of breath durations.
+   */
+  void setRate(float rpm, float drift_=0, float variability=0) {
+    meanRpm = rpm;
+    rpmDrift = drift_;
+    breathVariability = variability;
+  }
+
+  /// Sets mean breath depth (ADC units) and its relative standard deviation.
+  void setDepth(float depth_, float variability=0) {
+    depth = depth_;
+    depthVariability = variability;
+  }
+
+  /// Sets level at the end of inhalation (ADC units).
+  void setBaseline(float level) {
+    baseline = level;
+  }
+
+  /// Sets fraction of each breath spent exhaling.
+  void setExhaleRatio(float ratio) {
+    exhaleRatio = ratio > 0.1f ? (ratio < 0.9f ? ratio : 0.9f) : 0.1f;
+  }
+
+  /// Sets time constant of the thermistor response (seconds).
+  void setThermalTimeConstant(float seconds) {
+    thermalSmoothing = 1 - expf(-dt / (seconds > 0 ? seconds : dt));
+  }
+
+  /// Restarts the signal from the beginning with the given seed.
+  void restart(uint32_t seed) {
+    SignalGenerator::restart(seed);
+    phase = 0;
+    drift = 0;
+    breath = false;
+    temperature = baseline;
+    nextBreath();
+  }
+
+  /// Returns next sample.
+  float next() {
+    drift = wander(drift, 60, rpmDrift);
+
+    breath = false;
+    phase += dt / duration;
+    if (phase >= 1) {
+      phase -= 1;
+      nextBreath();
+      breath = true;
+    }
+
+    // Air temperature: rises while exhaling, falls while inhaling.
+    float shape = phase < exhaleRatio ?
+        0.5f - 0.5f * cosf(float(ConstMath::pi) * phase / exhaleRatio) :
+        0.5f + 0.5f * cosf(float(ConstMath::pi) * (phase - exhaleRatio) / (1 - exhaleRatio));
+    temperature += thermalSmoothing * (baseline + breathDepth * shape - temperature);
+    return output(temperature);
+  }
+
+  /// Returns true if an exhalation started at the last sample.
+  bool breathOccurred() const {
+    return breath;
+  }
+
+  /// Returns true if exhaling.
+  bool isExhaling() const {
+    return phase < exhaleRatio;
+  }
+
+  /// Returns duration of the current breath (milliseconds).
+  float getInterval() const {
+    return duration * 1000;
+  }
+
+  /// Returns respiration rate of the current breath (per minute).
+  float getRpm() const {
+    return 60 / duration;
+  }
+
+private:
+  void nextBreath() {
+    float rpm = meanRpm + drift;
+    if (rpm < 4) rpm = 4;
+    else if (rpm > 40) rpm = 40;
+    duration = (60 / rpm) * (1 + breathVariability * random.gaussian());
+    if (duration < 1) duration = 1;
+    breathDepth = depth * (1 + depthVariability * random.gaussian());
+    if (breathDepth < 0) breathDepth = 0;
+  }
+};
+
+#endif
@@ -0,0 +1,263 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Streaming signal quality index of a raw sensor signal, in O(1) per sample.
+ * Each sample is checked for:
+ *
+ *  - clipping:   sample at (or beyond) the ends of the ADC range;
+ *  - saturation: signal pinned near the ends of the range (eg. amplifier
+ *                saturated by motion, loose electrode);
+ *  - flatline:   signal staying within a few ADC steps for too long
+ *                (disconnected sensor);
+ *  - slope:      jump between consecutive samples faster than any
+ *                physiological change (motion, electrode pop);
+ *  - noise:      local signal-to-noise ratio too low, the noise being
+ *                estimated from the power of the first difference.
+ *
+ *   SignalQuality quality(1023, 200); // full scale, sample rate
+ *   ...
+ *   quality.update(value);
+ *   if (quality.isGood()) ... // process sample
+ *
+ * A sample is bad while any check fails, and for a hold time after, so that
+ * the edges of artifacts are excluded as well. Heart and SkinConductance use
+ * it to skip bad samples (see Heart::setQualityGating()).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIGNAL_QUALITY_H_
+#define SIGNAL_QUALITY_H_
+
+#include <math.h>
+#include <stdint.h>
+
+/// Checks failed by a sample (see SignalQuality::getFlags()).
+enum SignalQualityFlag {
+  QUALITY_CLIPPING   = 0x01,
+  QUALITY_SATURATION = 0x02,
+  QUALITY_FLATLINE   = 0x04,
+  QUALITY_SLOPE      = 0x08,
+  QUALITY_NOISE      = 0x10
+};
+
+class SignalQuality {
+  // Settings (in ADC units and seconds).
+  float minimumValue;
+  float maximumValue;
+  float saturationMargin;
+  float saturationTime;
+  float flatlineTolerance;
+  float flatlineTime;
+  float maxSlope;
+  float minSnr;
+  float snrTime;
+  float holdTime;
+  float indexTime;
+  unsigned long rate;
+
+  // Settings converted to samples at the sample rate.
+  float maxStep;
+  float minSnrRatio;
+  uint32_t flatlineSamples;
+  uint32_t holdSamples;
+  float saturationSmoothing;
+  float snrSmoothing;
+  float indexSmoothing;
+
+  // State.
+  bool started;
+  float previous;
+  float flatlineAnchor;
+  uint32_t flatlineCount;
+  float saturation;      // fraction of recent samples near the range ends
+  float mean;
+  float signalPower;     // variance around mean
+  float noisePower;      // half the mean squared first difference
+  uint32_t holdCount;
+  uint8_t flags;
+  float qualityIndex;
+
+  // Smoothing factor of an exponential moving average with given time constant.
+  float smoothing(float seconds) const {
+    return seconds > 0 ? 1 - expf(-1.0f / (seconds * rate)) : 1;
+  }
+
+  void updateSettings() {
+    maxStep = maxSlope / rate;
+    minSnrRatio = powf(10, minSnr / 10);
+    flatlineSamples = (uint32_t)(flatlineTime * rate);
+    holdSamples = (uint32_t)(holdTime * rate);
+    saturationSmoothing = smoothing(saturationTime);
+    snrSmoothing = smoothing(snrTime);
+    indexSmoothing = smoothing(indexTime);
+  }
+
+public:
+  /// Constructor: fullScale is the largest ADC value (eg. 1023 for 10 bits).
+  SignalQuality(float fullScale=1023, unsigned long rate_=200)
+    : minimumValue(0), maximumValue(fullScale),
+      saturationMargin(0.02f * fullScale), saturationTime(0.5f),
+      flatlineTolerance(1), flatlineTime(1),
+      maxSlope(20 * fullScale),
+      minSnr(0), snrTime(1),
+      holdTime(0.25f), indexTime(1),
+      rate(rate_ > 0 ? rate_ : 1) {
+    updateSettings();
+    reset();
+  }
+
+  /// Sets the range of the ADC: samples at either end are clipped.
+  void setRange(float minimum, float maximum) {
+    minimumValue = minimum;
+    maximumValue = maximum;
+  }
+
+  /**
+   * Signal is saturated when more than half of the samples of the last
+   * seconds are within margin of the ends of the range.
+   */
+  void setSaturation(float margin, float seconds) {
+    saturationMargin = margin;
+    saturationTime = seconds;
+    updateSettings();
+  }
+
+  /// Signal is flat when it stays within tolerance for seconds (0 to disable).
+  void setFlatline(float tolerance, float seconds) {
+    flatlineTolerance = tolerance;
+    flatlineTime = seconds;
+    updateSettings();
+  }
+
+  /// Sets largest plausible slope in ADC units per second.
+  void setMaxSlope(float unitsPerSecond) {
+    maxSlope = unitsPerSecond;
+    updateSettings();
+  }
+
+  /**
+   * Sets smallest acceptable signal-to-noise ratio in dB (-INFINITY to
+   * disable), estimated over the last seconds.
+   */
+  void setMinSnr(float decibels, float seconds=1) {
+    minSnr = decibels;
+    snrTime = seconds;
+    updateSettings();
+  }
+
+  /// Samples stay bad for seconds after the last failed check.
+  void setHoldTime(float seconds) {
+    holdTime = seconds;
+    updateSettings();
+  }
+
+  /// Sets sample rate.
+  void setSampleRate(unsigned long rate_) {
+    rate = rate_ > 0 ? rate_ : 1;
+    updateSettings();
+  }
+
+  /// Restarts estimation.
+  void reset() {
+    started = false;
+    previous = flatlineAnchor = mean = 0;
+    flatlineCount = 0;
+    saturation = 0;
+    signalPower = noisePower = 0;
+    holdCount = 0;
+    flags = 0;
+    qualityIndex = 1;
+  }
+
+  /// Checks next sample. Returns true if it is good.
+  bool update(float value) {
+    if (!started) {
+      started = true;
+      previous = flatlineAnchor = mean = value;
+    }
+    float step = value - previous;
+    previous = value;
+    flags = 0;
+
+    if (value <= minimumValue || value >= maximumValue)
+      flags |= QUALITY_CLIPPING;
+
+    bool nearEnd = (value <= minimumValue + saturationMargin || value >= maximumValue - saturationMargin);
+    saturation += saturationSmoothing * ((nearEnd ? 1 : 0) - saturation);
+    if (saturation > 0.5f)
+      flags |= QUALITY_SATURATION;
+
+    if (fabsf(value - flatlineAnchor) > flatlineTolerance) {
+      flatlineAnchor = value;
+      flatlineCount = 0;
+    }
+    else if (flatlineCount < flatlineSamples)
+      flatlineCount++;
+    if (flatlineSamples > 0 && flatlineCount >= flatlineSamples)
+      flags |= QUALITY_FLATLINE;
+
+    if (fabsf(step) > maxStep)
+      flags |= QUALITY_SLOPE;
+
+    // The first difference of white noise has twice its power, while slow
+    // physiological signals contribute little to it.
+    float deviation = value - mean;
+    mean += snrSmoothing * deviation;
+    signalPower += snrSmoothing * (deviation * deviation - signalPower);
+    noisePower += snrSmoothing * (0.5f * step * step - noisePower);
+    if (signalPower < minSnrRatio * noisePower)
+      flags |= QUALITY_NOISE;
+
+    if (flags)
+      holdCount = holdSamples + 1;
+    if (holdCount > 0)
+      holdCount--;
+
+    bool good = isGood();
+    qualityIndex += indexSmoothing * ((good ? 1 : 0) - qualityIndex);
+    return good;
+  }
+
+  /// Same as update() but returns the quality index (eg. for use in a Pipeline).
+  float filter(float value) {
+    update(value);
+    return qualityIndex;
+  }
+
+  /// Returns true if the last sample is good (no failed check, nor within hold time of one).
+  bool isGood() const {
+    return flags == 0 && holdCount == 0;
+  }
+
+  /// Returns the checks failed by the last sample (see SignalQualityFlag).
+  uint8_t getFlags() const {
+    return flags;
+  }
+
+  /// Returns fraction of good samples over the last second, from 0 (bad) to 1 (good).
+  float getIndex() const {
+    return qualityIndex;
+  }
+
+  /// Returns estimated signal-to-noise ratio in dB.
+  float getSnr() const {
+    if (noisePower <= 0)
+      return signalPower > 0 ? INFINITY : 0;
+    return 10 * log10f(signalPower / noisePower);
+  }
+};
+
+#endif
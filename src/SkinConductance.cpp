@@ -29,69 +29,6 @@
  */
 #include "SkinConductance.h"
 
-float alpha_1 = 0.01;
-float alpha_2 = 0.005;
-
-SkinConductance::SkinConductance(unsigned long rate)
-{
-  initialize(rate);
-}
-
-void SkinConductance::initialize(unsigned long rate) {
-  gsrSensorSignal = 0;
-
-  gsrSensorFiltered = 0;
-  gsrSensorLopFiltered = 0;
-  gsrSensorAmplitude = 0;
-  gsrSensorLopassed = 0;
-  gsrSensorChangeFiltered = 0;
-
-  timer.start();
-
-  prevSampleMicros = timer.getMicros();
-  setSampleRate(rate);
-}
-
-void SkinConductance::setSampleRate(unsigned long rate) {
-  _sampleRate = rate;
-  microsBetweenSamples = 1000000UL / _sampleRate;
-}
-
-void SkinConductance::update(float signal) {
-  unsigned long t = timer.getMicros();
-  if (t - prevSampleMicros >= microsBetweenSamples) {
-    // Perform updates.
-    sample(signal);
-    prevSampleMicros = t;
-  }
-}
-
-float SkinConductance::getSCR() const {
-    return gsrSensorChange;
-}
-
-float SkinConductance::getSCL() const {
-    return gsrSensorLopFiltered;
-}
-
-int32_t SkinConductance::getRaw() const {
-  return gsrSensorSignal;
-}
-
-void SkinConductance::sample(float signal) {
-    // Read sensor value and invert it.
-    // TODO : How do we do this if the signal comes from a 16-bit ADC or a measurement? Normalize or scale before inverting?
-    gsrSensorSignal = signal; 
-    float gsrSensorInverted = 1023 - signal; 
-    
-    gsrSensorLop = alpha_1*gsrSensorInverted + (1 - alpha_1)*gsrSensorLop;
-    gsrSensorLopassed = alpha_2*gsrSensorLop + (1 - alpha_2)*gsrSensorLopassed;
-
-    gsrSensorChange = ((gsrSensorLop - gsrSensorLopassed)/10)+0.2;
-
-    gsrSensorLopFiltered = mapper(gsrSensorLop, 1023, 0, 0, 1000)*0.001;
-
-    gsrSensorChange = clamp(gsrSensorChange, 0, 1);
-    // TODO : is the raw signal we want to give out inverted or not? option to get raw input and inverted signal??
-}
-
+// The implementation lives in SkinConductance.h since the class is configured
+// at compile time. The default 10-bit configuration is instantiated here once.
+template class BasicSkinConductance<>;
@@ -27,10 +27,19 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "Average.h"
+#include "Events.h"
 #include "MinMax.h"
 #include "Lop.h"
 #include "Hip.h"
+#include "Resampler.h"
+#include "SampleClock.h"
+#include "SignalQuality.h"
+#include "State.h"
+#include "Threshold.h"
 #include "Timing.h"
 #include "utils.h"
 
@@ -38,29 +47,92 @@
 #ifndef SKIN_CONDUCTANCE_H_
 #define SKIN_CONDUCTANCE_H_
 
+/**
+ * Compile-time configuration of the skin conductance processing.
+ *
+ * The template argument is the resolution of the ADC in bits: 10 for the
+ * default analogRead() of most boards, 12 or 13 for Teensy analogReadResolution(),
+ * 15 for single-ended readings of an ADS1115 (its 16-bit output is signed).
+ *
+ * To change the filter constants, derive from this struct and hide the
+ * members you want to change:
+ *
+ *   struct MyConfig : SkinConductanceConfig<15> {
+ *     static constexpr float levelSmoothing = 0.02f;
+ *   };
+ *   BasicSkinConductance<MyConfig> sc;
+ */
+template <uint8_t ADC_BITS = 10>
+struct SkinConductanceConfig {
+  /// ADC resolution in bits.
+  static constexpr uint8_t adcBits = ADC_BITS;
+
+  /// Smoothing factor of the skin conductance level low-pass (lower value = smoother).
+  static constexpr float levelSmoothing = 0.01f;
+
+  /// Smoothing factor of the baseline low-pass used to extract responses.
+  static constexpr float baselineSmoothing = 0.005f;
+
+  /// Gain applied to (level - baseline), with level and baseline expressed
+  /// as fractions of the ADC full scale. 102.3 is one tenth of the 10-bit
+  /// full scale (1023 / 10), so that a 10-bit signal gives the same response
+  /// as the original raw ADC change divided by 10.
+  static constexpr float responseGain = 102.3f;
+
+  /// Value of the skin conductance response when the level sits on its baseline.
+  static constexpr float responseOffset = 0.2f;
+
+  /// An EVENT_SCR is sent when the response rises above responseOnset, then
+  /// not again until it falls back below responseRelease.
+  static constexpr float responseOnset = 0.5f;
+  static constexpr float responseRelease = 0.3f;
+};
 
-class SkinConductance {
+template <class Config = SkinConductanceConfig<> >
+class BasicSkinConductance {
 
-  int gsrSensorSignal;
+  // Full-scale value of the ADC, eg. 1023 for a 10-bit ADC.
+  static constexpr float fullScale = float((1UL << Config::adcBits) - 1);
+
+  // Folded scaling factors: the inversion of the signal and its mapping to
+  // [0, 1] reduce to a single multiply on the smoothed raw signal.
+  static constexpr float levelScale    = 1.0f / fullScale;
+  static constexpr float responseScale = Config::responseGain / fullScale;
+
+  int32_t gsrSensorSignal;
 
-  float gsrSensorFiltered;
   float gsrSensorLopFiltered;
   float gsrSensorChange;
-  float gsrSensorChangeFiltered;
-  float gsrSensorAmplitude;
   float gsrSensorLop;
   float gsrSensorLopassed;
 
   // Sample rate in Hz.
   unsigned long _sampleRate;
 
-  // Internal use.
-  unsigned long microsBetweenSamples;
-  unsigned long prevSampleMicros;
+  // Internal use: decides when update() samples and tracks missed samples.
+  SampleClock sampleClock;
+
+  // Last signal passed to update() (none yet if prevSignalValid is false).
+  float prevSignal;
+  bool prevSignalValid;
+
+  // Brings timestamped samples onto the sample rate grid.
+  Resampler resampler;
+
+  // Time of the sample being processed (microseconds).
+  unsigned long sampleMicros;
+
+  // Detects response onsets and receives SCR events.
+  Threshold responseDetector;
+  EventEmitter events;
+
+  // Signal quality of the raw signal. When gating, bad samples are skipped.
+  SignalQuality quality;
+  bool qualityGating;
 
 public:
-  SkinConductance(unsigned long rate=50); // default SC samplerate is 50Hz
-  virtual ~SkinConductance() {}
+  BasicSkinConductance(unsigned long rate=50); // default SC samplerate is 50Hz
+  virtual ~BasicSkinConductance() {}
 
   Timing timer;
 
@@ -70,24 +142,298 @@ public:
   /// Sets sample rate.
   void setSampleRate(unsigned long rate=50);
 
+  /**
+   * Skips samples of bad quality (clipping, saturation, electrode pops; see
+   * SignalQuality): level, baseline and response detection hold their state
+   * until the signal is good again. Disabled by default.
+   */
+  void setQualityGating(bool enabled=true);
+
+  /// Returns signal quality estimation (eg. to adjust its settings).
+  SignalQuality& getQuality();
+
+  /// Returns signal quality of the last sample (only updated when gating).
+  const SignalQuality& getQuality() const;
+
   /**
    * Reads the signal and perform filtering operations. Call this before
    * calling any of the access functions.
    */
   void update(float signal);
 
+  /**
+   * Same as update(signal) but for a sample taken at timestampMicros (eg.
+   * a hardware timestamp). Samples are interpolated onto the sample rate grid.
+   */
+  void update(float signal, unsigned long timestampMicros);
+
+  /// Calls update(signal, timestampMicros) on n timestamped samples.
+  void updateBlock(const float* signals, const unsigned long* timestampsMicros, size_t n);
+
+  /**
+   * When update() is called late, processes up to maxSamples of the elapsed
+   * sample periods (interpolating the signal) instead of a single sample.
+   * Default is 1 (no catch-up).
+   */
+  void setCatchUp(unsigned int maxSamples);
+
+  /// Returns number of sample periods skipped by update() since initialization.
+  unsigned long getMissedSamples() const;
+
+  /// Returns worst delay of update() past a sample due time (microseconds).
+  unsigned long getWorstLateness() const;
+
+  /// Returns the rate at which update() actually processed samples (Hz).
+  float getEffectiveSampleRate() const;
+
+  /**
+   * Sends an EVENT_SCR to handler at each skin conductance response onset,
+   * with the SCR as value (NULL to disable).
+   */
+  void setEventHandler(BioEventHandler handler, void* context=NULL);
+
   /// Returns skin conductance response (SRC).
   float getSCR() const;
 
   /// Returns skin conductance level (SCL).
   float getSCL() const;
 
-  /// Returns raw signal as returned by analogRead() (inverted).
+  /// Returns raw signal as returned by analogRead().
   int32_t getRaw() const;
 
+  /**
+   * Saves the state of the sensor (level and baseline) into buffer so that
+   * it can resume without settling again. Returns the size of the state: if
+   * larger than size, nothing usable was written.
+   */
+  size_t saveState(uint8_t* buffer, size_t size) const;
+
+  /**
+   * Restores state saved by saveState() into a sensor with the same
+   * configuration. Returns false and keeps the current state if the data
+   * is invalid.
+   */
+  bool loadState(const uint8_t* buffer, size_t size);
+
+  /// Writes state without header (eg. to embed it in a larger snapshot).
+  void saveState(StateWriter& out) const;
+
+  /// Reads state written by saveState(StateWriter&).
+  bool loadState(StateReader& in);
+
   // Performs the actual adjustments of signals and filterings.
   // Internal use: don't use directly, use update() instead.
   void sample(float signal);
+
+  // Same as sample(signal) for a sample taken at timestampMicros.
+  void sample(float signal, unsigned long timestampMicros);
 };
 
+/// Skin conductance sensor read through a 10-bit ADC.
+typedef BasicSkinConductance<> SkinConductance;
+
+template <class Config>
+BasicSkinConductance<Config>::BasicSkinConductance(unsigned long rate)
+  : responseDetector(Config::responseRelease, Config::responseOnset),
+    quality(fullScale, rate),
+    qualityGating(false)
+{
+  // The level of a still subject can stay within one ADC step for minutes
+  // and is much slower than its quantization noise: only check for
+  // clipping, saturation and jumps.
+  quality.setFlatline(0, 0);
+  quality.setMinSnr(-INFINITY);
+  initialize(rate);
+}
+
+template <class Config>
+void BasicSkinConductance<Config>::initialize(unsigned long rate) {
+  gsrSensorSignal = 0;
+
+  // The filters run on the raw (non-inverted) signal: starting them at full
+  // scale is the same as starting the inverted signal filters at zero.
+  gsrSensorLop = gsrSensorLopassed = fullScale;
+  gsrSensorLopFiltered = 0;
+  gsrSensorChange = 0;
+  responseDetector.reset();
+  quality.reset();
+
+  timer.start();
+  sampleMicros = timer.getMicros();
+
+  sampleClock.reset(timer.getMicros());
+  resampler.reset();
+  prevSignal = 0;
+  prevSignalValid = false;
+  setSampleRate(rate);
+}
+
+template <class Config>
+void BasicSkinConductance<Config>::setSampleRate(unsigned long rate) {
+  _sampleRate = rate;
+  sampleClock.setPeriod(1000000UL / _sampleRate);
+  resampler.setPeriod(sampleClock.getPeriod());
+  quality.setSampleRate(_sampleRate);
+}
+
+template <class Config>
+void BasicSkinConductance<Config>::setQualityGating(bool enabled) {
+  qualityGating = enabled;
+  quality.reset();
+}
+
+template <class Config>
+SignalQuality& BasicSkinConductance<Config>::getQuality() {
+  return quality;
+}
+
+template <class Config>
+const SignalQuality& BasicSkinConductance<Config>::getQuality() const {
+  return quality;
+}
+
+template <class Config>
+void BasicSkinConductance<Config>::update(float signal) {
+  float previousSignal = prevSignalValid ? prevSignal : signal;
+  prevSignal = signal;
+  prevSignalValid = true;
+  unsigned long n = sampleClock.tick(timer.getMicros());
+
+  // Perform updates. When catching up, samples due since the previous call
+  // are interpolated between the previous and current signal (held at the
+  // current signal before the first one).
+  unsigned long t = sampleClock.getLastMicros();
+  for (unsigned long k = 1; k <= n; k++)
+    sample(previousSignal + (signal - previousSignal) * k / n, t - (n - k) * sampleClock.getPeriod());
+}
+
+template <class Config>
+void BasicSkinConductance<Config>::update(float signal, unsigned long timestampMicros) {
+  resampler.push(signal, timestampMicros);
+
+  float value;
+  unsigned long t;
+  while (resampler.next(value, t))
+    sample(value, t);
+}
+
+template <class Config>
+void BasicSkinConductance<Config>::updateBlock(const float* signals, const unsigned long* timestampsMicros, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    update(signals[i], timestampsMicros[i]);
+}
+
+template <class Config>
+void BasicSkinConductance<Config>::setCatchUp(unsigned int maxSamples) {
+  sampleClock.setCatchUp(maxSamples);
+}
+
+template <class Config>
+unsigned long BasicSkinConductance<Config>::getMissedSamples() const {
+  return sampleClock.getMissedCount();
+}
+
+template <class Config>
+unsigned long BasicSkinConductance<Config>::getWorstLateness() const {
+  return sampleClock.getWorstLateness();
+}
+
+template <class Config>
+float BasicSkinConductance<Config>::getEffectiveSampleRate() const {
+  return sampleClock.getEffectiveRate();
+}
+
+template <class Config>
+void BasicSkinConductance<Config>::setEventHandler(BioEventHandler handler, void* context) {
+  events.setHandler(handler, context);
+}
+
+template <class Config>
+float BasicSkinConductance<Config>::getSCR() const {
+  return gsrSensorChange;
+}
+
+template <class Config>
+float BasicSkinConductance<Config>::getSCL() const {
+  return gsrSensorLopFiltered;
+}
+
+template <class Config>
+int32_t BasicSkinConductance<Config>::getRaw() const {
+  return gsrSensorSignal;
+}
+
+template <class Config>
+size_t BasicSkinConductance<Config>::saveState(uint8_t* buffer, size_t size) const {
+  return saveStateBlob(*this, STATE_SKIN_CONDUCTANCE, buffer, size);
+}
+
+template <class Config>
+bool BasicSkinConductance<Config>::loadState(const uint8_t* buffer, size_t size) {
+  return loadStateBlob(*this, STATE_SKIN_CONDUCTANCE, buffer, size);
+}
+
+template <class Config>
+void BasicSkinConductance<Config>::saveState(StateWriter& out) const {
+  // Filters are in ADC units: keep the resolution to reject other configurations.
+  out.write((uint8_t)Config::adcBits);
+  out.write(gsrSensorLop);
+  out.write(gsrSensorLopassed);
+  out.write(gsrSensorLopFiltered);
+  out.write(gsrSensorChange);
+  responseDetector.saveState(out);
+}
+
+template <class Config>
+bool BasicSkinConductance<Config>::loadState(StateReader& in) {
+  uint8_t adcBits;
+  float state[4];
+  if (!in.read(adcBits) || adcBits != Config::adcBits || !in.read(state) || !responseDetector.loadState(in))
+    return false;
+  gsrSensorLop         = state[0];
+  gsrSensorLopassed    = state[1];
+  gsrSensorLopFiltered = state[2];
+  gsrSensorChange      = state[3];
+
+  // Time bases are not saved: restart them now.
+  quality.reset();
+  sampleMicros = timer.getMicros();
+  sampleClock.reset(sampleMicros);
+  resampler.reset();
+  return true;
+}
+
+template <class Config>
+void BasicSkinConductance<Config>::sample(float signal) {
+  sample(signal, timer.getMicros());
+}
+
+template <class Config>
+void BasicSkinConductance<Config>::sample(float signal, unsigned long timestampMicros) {
+  sampleMicros = timestampMicros;
+  gsrSensorSignal = signal;
+
+  // Artifacts would pull the level and baseline for their whole time constants.
+  if (qualityGating && !quality.update(signal))
+    return;
+
+  // Conductance rises when the measured signal falls, ie. level = fullScale - signal.
+  // Both low-passes are linear so they are applied to the raw signal and the
+  // inversion is folded in the output scaling below.
+  gsrSensorLop      += Config::levelSmoothing    * (signal       - gsrSensorLop);
+  gsrSensorLopassed += Config::baselineSmoothing * (gsrSensorLop - gsrSensorLopassed);
+
+  // Inverted level minus inverted baseline == baseline minus level.
+  gsrSensorChange = clamp((gsrSensorLopassed - gsrSensorLop) * responseScale + Config::responseOffset, 0, 1);
+
+  // Level mapped from [fullScale, 0] (inverted) to [0, 1].
+  gsrSensorLopFiltered = gsrSensorLop * levelScale;
+
+  if (responseDetector.detect(gsrSensorChange))
+    events.emit(EVENT_SCR, sampleMicros, gsrSensorChange, this);
+}
+
+// Default configuration is compiled once in SkinConductance.cpp.
+extern template class BasicSkinConductance<>;
+
 #endif
@@ -0,0 +1,169 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Binary snapshots of filter and sensor state, so that a device rebooting
+ * mid-session (or a server worker restarting) can resume with settled
+ * baselines instead of going through calibration again.
+ *
+ * Primitives write their state to a StateWriter and read it back from a
+ * StateReader. Sensors wrap their state in a blob with a header (magic,
+ * format version, sensor type, payload size):
+ *
+ *   uint8_t blob[128];
+ *   size_t n = heart.saveState(blob, sizeof(blob)); // store n bytes (eg. EEPROM)
+ *   ...
+ *   if (!heart.loadState(blob, n)) { ... } // blob rejected: keeps current state
+ *
+ * Only state is saved, not settings (smoothing factors, thresholds, sample
+ * rate...): restore into an object configured the same way. Values are
+ * stored in the byte order of the machine, so a blob is meant to be loaded
+ * on the same kind of machine that saved it (other byte orders are rejected
+ * by the magic number check).
+ *
+ * Respiration can only resume partly: its Plaquette filters are not saved
+ * (see Respiration::saveState()).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATE_H_
+#define STATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// Sensor blob header values.
+static const uint32_t STATE_MAGIC   = 0x42445354UL; // "BDST"
+static const uint8_t  STATE_VERSION = 1;
+
+/// Sensor types stored in blob headers.
+enum StateType {
+  STATE_HEART = 1,
+  STATE_SKIN_CONDUCTANCE = 2,
+  STATE_RESPIRATION = 3
+};
+
+/**
+ * Writes values into a buffer. Writes past the end of the buffer are not
+ * performed but still counted, so that getSize() gives the size needed.
+ */
+class StateWriter {
+  uint8_t* buffer;
+  size_t capacity;
+  size_t offset;
+
+public:
+  /// Constructor. A NULL buffer only counts bytes.
+  StateWriter(uint8_t* buffer_, size_t capacity_) : buffer(buffer_), capacity(capacity_), offset(0) {}
+
+  /// Writes n bytes.
+  void write(const void* data, size_t n) {
+    if (buffer && offset + n <= capacity)
+      memcpy(buffer + offset, data, n);
+    offset += n;
+  }
+
+  /// Writes a value.
+  template <class T>
+  void write(const T& value) {
+    write(&value, sizeof(T));
+  }
+
+  /// Returns number of bytes written (or needed) so far.
+  size_t getSize() const {
+    return offset;
+  }
+
+  /// Returns true if everything written so far fit in the buffer.
+  bool isValid() const {
+    return buffer && offset <= capacity;
+  }
+};
+
+/// Reads values from a buffer. Reads past the end of the buffer fail.
+class StateReader {
+  const uint8_t* buffer;
+  size_t capacity;
+  size_t offset;
+
+public:
+  /// Constructor.
+  StateReader(const uint8_t* buffer_, size_t capacity_) : buffer(buffer_), capacity(capacity_), offset(0) {}
+
+  /// Reads n bytes. Returns false (and reads nothing) if fewer are available.
+  bool read(void* data, size_t n) {
+    if (n > getAvailable())
+      return false;
+    memcpy(data, buffer + offset, n);
+    offset += n;
+    return true;
+  }
+
+  /// Reads a value.
+  template <class T>
+  bool read(T& value) {
+    return read(&value, sizeof(T));
+  }
+
+  /// Returns number of bytes left to read.
+  size_t getAvailable() const {
+    return buffer ? capacity - offset : 0;
+  }
+};
+
+/**
+ * Saves the state of object (which has a saveState(StateWriter&) method) as
+ * a blob of given type. Returns the size of the blob: if it is larger than
+ * size, the blob was not entirely written.
+ */
+template <class T>
+size_t saveStateBlob(const T& object, uint8_t type, uint8_t* buffer, size_t size) {
+  StateWriter payload(NULL, 0);
+  object.saveState(payload);
+
+  StateWriter out(buffer, size);
+  out.write(STATE_MAGIC);
+  out.write(STATE_VERSION);
+  out.write(type);
+  out.write((uint16_t)payload.getSize());
+  object.saveState(out);
+  return out.getSize();
+}
+
+/**
+ * Restores the state of object (which has saveState(StateWriter&) and
+ * loadState(StateReader&) methods) from a blob of given type. Returns false
+ * and leaves object unchanged if the blob is invalid, of another type or
+ * version, or does not match the layout of object.
+ */
+template <class T>
+bool loadStateBlob(T& object, uint8_t type, const uint8_t* buffer, size_t size) {
+  StateWriter payload(NULL, 0);
+  object.saveState(payload);
+
+  StateReader in(buffer, size);
+  uint32_t magic;
+  uint8_t version, blobType;
+  uint16_t payloadSize;
+  if (!in.read(magic) || !in.read(version) || !in.read(blobType) || !in.read(payloadSize))
+    return false;
+  if (magic != STATE_MAGIC || version != STATE_VERSION || blobType != type ||
+      payloadSize != payload.getSize() || in.getAvailable() < payloadSize)
+    return false;
+  return object.loadState(in);
+}
+
+#endif
@@ -0,0 +1,217 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Mergeable summary of a sequence of values: count, mean, variance, least
+ * squares line against the position in the sequence, minimum and maximum.
+ *
+ * Summaries of consecutive chunks of a signal can be computed separately
+ * (on several threads or computers) and merged into the summary of the
+ * whole signal, with the same result as adding all values to one summary:
+ *
+ *   Summary first, second;
+ *   for (...) first.add(chunk1[i]);
+ *   for (...) second.add(chunk2[i]);
+ *   first.merge(second); // summary of chunk1 followed by chunk2
+ *
+ * Moments are updated with Welford's method and merged with Chan et al.'s
+ * formulas, which avoid the cancellation of raw sums of squares.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUMMARY_H_
+#define SUMMARY_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#include "State.h"
+
+class Summary {
+  uint64_t count;
+
+  // Values.
+  double yMean;
+  double yM2;     // sum of squared deviations from yMean
+
+  // Positions in the sequence (0, 1, 2...) and co-moment with the values.
+  double xMean;
+  double xM2;
+  double xyM2;    // sum of (x - xMean) * (y - yMean)
+
+  float minimumValue;
+  float maximumValue;
+
+public:
+  /// Constructor.
+  Summary() {
+    clear();
+  }
+
+  /// Resets to an empty summary.
+  void clear() {
+    count = 0;
+    yMean = yM2 = xMean = xM2 = xyM2 = 0;
+    minimumValue = maximumValue = 0;
+  }
+
+  /**
+   * Returns the summary of count values from their mean, sum of squared
+   * deviations m2 and co-moment xyM2 with their positions (sum of
+   * (position - (count - 1) / 2) * (value - mean)), eg. kept by a sliding
+   * window (see Average::summary()).
+   */
+  static Summary fromMoments(uint64_t count, double mean, double m2, double xyM2, float minimum, float maximum) {
+    Summary summary;
+    if (count == 0)
+      return summary;
+    double n = (double)count;
+    summary.count = count;
+    summary.yMean = mean;
+    summary.yM2 = m2;
+    summary.xMean = (n - 1) / 2;
+    summary.xM2 = n * (n * n - 1) / 12;
+    summary.xyM2 = xyM2;
+    summary.minimumValue = minimum;
+    summary.maximumValue = maximum;
+    return summary;
+  }
+
+  /// Adds the next value of the sequence.
+  void add(float value) {
+    double x = (double)count;
+    double y = value;
+    if (count == 0 || value < minimumValue) minimumValue = value;
+    if (count == 0 || value > maximumValue) maximumValue = value;
+    count++;
+
+    double dx = x - xMean;
+    double dy = y - yMean;
+    xMean += dx / count;
+    yMean += dy / count;
+    xM2  += dx * (x - xMean);
+    yM2  += dy * (y - yMean);
+    xyM2 += dx * (y - yMean);
+  }
+
+  /**
+   * Merges the summary of the values that follow this summary's values.
+   * Order only matters for slope(), intercept() and correlation().
+   */
+  void merge(const Summary& next) {
+    if (next.count == 0)
+      return;
+    if (count == 0) {
+      *this = next;
+      return;
+    }
+    if (next.minimumValue < minimumValue) minimumValue = next.minimumValue;
+    if (next.maximumValue > maximumValue) maximumValue = next.maximumValue;
+
+    double n1 = (double)count;
+    double n2 = (double)next.count;
+    double n = n1 + n2;
+    double dx = (next.xMean + n1) - xMean; // positions of next follow ours
+    double dy = next.yMean - yMean;
+    double weight = n1 * n2 / n;
+
+    xMean += dx * n2 / n;
+    yMean += dy * n2 / n;
+    xM2  += next.xM2  + dx * dx * weight;
+    yM2  += next.yM2  + dy * dy * weight;
+    xyM2 += next.xyM2 + dx * dy * weight;
+    count += next.count;
+  }
+
+  /// Returns number of values.
+  uint64_t getCount() const {
+    return count;
+  }
+
+  /// Returns sum of values.
+  double sum() const {
+    return yMean * count;
+  }
+
+  /// Returns mean of values.
+  float mean() const {
+    return (float)yMean;
+  }
+
+  /// Returns population variance (as Average::stddev()).
+  float variance() const {
+    return count ? (float)(yM2 / count) : 0;
+  }
+
+  /// Returns population standard deviation (as Average::stddev()).
+  float stddev() const {
+    return sqrtf(variance());
+  }
+
+  /// Returns sample variance (divided by count - 1).
+  float sampleVariance() const {
+    return count > 1 ? (float)(yM2 / (count - 1)) : 0;
+  }
+
+  /// Returns smallest value.
+  float minimum() const {
+    return minimumValue;
+  }
+
+  /// Returns largest value.
+  float maximum() const {
+    return maximumValue;
+  }
+
+  /// Returns slope of the least squares line of values against their position.
+  float slope() const {
+    return xM2 > 0 ? (float)(xyM2 / xM2) : 0;
+  }
+
+  /// Returns value of the least squares line at position 0.
+  float intercept() const {
+    return (float)(yMean - slope() * xMean);
+  }
+
+  /// Returns correlation coefficient of values with their position.
+  float correlation() const {
+    return (xM2 > 0 && yM2 > 0) ? (float)(xyM2 / sqrt(xM2 * yM2)) : 0;
+  }
+
+  /// Writes summary (eg. to send it to the node that merges summaries).
+  void saveState(StateWriter& out) const {
+    out.write(count);
+    out.write(yMean);
+    out.write(yM2);
+    out.write(xMean);
+    out.write(xM2);
+    out.write(xyM2);
+    out.write(minimumValue);
+    out.write(maximumValue);
+  }
+
+  /// Reads summary written by saveState(). Returns false if data is missing.
+  bool loadState(StateReader& in) {
+    Summary summary;
+    if (!in.read(summary.count) || !in.read(summary.yMean) || !in.read(summary.yM2) ||
+        !in.read(summary.xMean) || !in.read(summary.xM2) || !in.read(summary.xyM2) ||
+        !in.read(summary.minimumValue) || !in.read(summary.maximumValue))
+      return false;
+    *this = summary;
+    return true;
+  }
+};
+
+#endif
@@ -26,6 +26,8 @@
 #ifndef THRESHOLD_H_
 #define THRESHOLD_H_
 
+#include "State.h"
+
 class Threshold {
   float lower;
   float upper;
@@ -38,6 +40,36 @@ public:
   this->upper = upper;
  }
 
+ /// Sets lower and upper bounds.
+ void setBounds(float lower, float upper) {
+  this->lower = lower;
+  this->upper = upper;
+ }
+
+ /// Resets detector.
+ void reset() {
+  triggered = false;
+ }
+
+ /// Same as detect() but returns 1 on detection and 0 otherwise (eg. for use in a Pipeline).
+ float filter(float value) {
+  return detect(value) ? 1 : 0;
+ }
+
+ /// Writes detector state.
+ void saveState(StateWriter& out) const {
+  out.write((uint8_t)triggered);
+ }
+
+ /// Reads detector state. Returns false if data is missing.
+ bool loadState(StateReader& in) {
+  uint8_t triggered_;
+  if (!in.read(triggered_))
+    return false;
+  triggered = triggered_;
+  return true;
+ }
+
  bool detect(float value) {
 
     if ( value >= upper && triggered == false ) {
@@ -0,0 +1,71 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * Compiled as gnu++11 (see CMakeLists.txt): includes the headers of the
+ * library, designs filters as constant expressions and instantiates the
+ * templates, so that anything the Arduino cores cannot compile fails here.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Arena.h"
+#include "Average.h"
+#include "Biquad.h"
+#include "CompensatedSum.h"
+#include "ConstMath.h"
+#include "Decimator.h"
+#include "Events.h"
+#include "FeatureFrame.h"
+#include "FeatureHistory.h"
+#include "FrameStreamer.h"
+#include "Heart.h"
+#include "Hip.h"
+#include "Lop.h"
+#include "MinMax.h"
+#include "Pipeline.h"
+#include "Profiler.h"
+#include "Resampler.h"
+#include "RollingStats.h"
+#include "SampleClock.h"
+#include "Scheduler.h"
+#include "SharedMemoryRing.h"
+#include "SignalGenerator.h"
+#include "SignalQuality.h"
+#include "SkinConductance.h"
+#include "State.h"
+#include "Summary.h"
+#include "Threshold.h"
+#include "Timing.h"
+
+// Filter designs must be constant expressions.
+constexpr BiquadDesign<2> BANDPASS = BiquadDesign<2>::butterworthBandpass(200, 0.5, 8);
+constexpr BiquadDesign<2> LOWPASS  = BiquadDesign<2>::butterworthLowpass(50, 2);
+constexpr BiquadDesign<1> HIGHPASS = BiquadDesign<1>::butterworthHighpass(50, 0.05);
+constexpr FirDesign<31> DECIMATION = FirDesign<31>::decimation(5);
+constexpr FirDesign<15> HALFBAND   = FirDesign<15>::halfband();
+
+static_assert(ConstMath::sin(0) == 0, "ConstMath::sin() is not a constant expression.");
+static_assert(BANDPASS.section[0].b0 > 0 && DECIMATION.taps[15] > HALFBAND.taps[0],
+              "Filter designs are not constant expressions.");
+
+// All members of the class templates.
+template class Average<float>;
+template class BiquadCascade<2>;
+template class BiquadBank<2, 3>;
+template class Decimator<5, 31>;
+template class EventQueue<8>;
+template class FeatureHistory<3>;
+template class Scheduler<4>;
+template class BasicSkinConductance<SkinConductanceConfig<12> >;
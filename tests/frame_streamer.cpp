@@ -0,0 +1,221 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * FrameStreamer to FrameReceiver over 127.0.0.1, in binary and OSC modes:
+ * frames are decoded with all their fields, the datagrams on the wire are
+ * big-endian, and lost or invalid datagrams are counted.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FrameStreamer.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while (0)
+
+static const int N_SUBJECTS = 40;
+static const int TIMEOUT_MILLIS = 500;
+
+static FeatureFrame makeFrame(int subject) {
+  FeatureFrame frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.sequence = 0x01020304 + subject;
+  frame.timestampMicros = 123456 + subject;
+  frame.version = FEATURE_FRAME_VERSION;
+  frame.flags = subject & 0x0F;
+  frame.beats = subject % 7;
+  frame.heartNormalized = 0.25f;
+  frame.bpm = 60.5f + subject;
+  frame.rpmVariability = -subject;
+  return frame;
+}
+
+struct Received {
+  int count;
+  int bad;
+  bool binary;
+};
+
+static void onFrame(uint16_t subject, const FeatureFrame& frame, void* context) {
+  Received* received = static_cast<Received*>(context);
+  FeatureFrame expected = makeFrame(subject);
+  // OSC does not carry the reserved byte.
+  bool ok = subject < N_SUBJECTS &&
+    frame.sequence == expected.sequence && frame.timestampMicros == expected.timestampMicros &&
+    frame.version == expected.version && frame.flags == expected.flags && frame.beats == expected.beats &&
+    memcmp(FrameDatagram::features(frame), FrameDatagram::features(expected), FrameDatagram::N_FEATURES * sizeof(float)) == 0;
+  if (!ok || (received->binary && frame.reserved != expected.reserved))
+    received->bad++;
+  received->count++;
+}
+
+// Listens on a free local port, returns it (0 on failure).
+static uint16_t listen(FrameReceiver& receiver) {
+  for (uint16_t port = 39000 + getpid() % 1000; port < 50000; port += 7)
+    if (receiver.open(port))
+      return port;
+  return 0;
+}
+
+// Opens a plain UDP socket on a free local port to look at raw datagrams.
+static int listenRaw(uint16_t& port) {
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  for (port = 41000 + getpid() % 1000; sock >= 0 && port < 50000; port += 7) {
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(sock, (const sockaddr*)&address, sizeof(address)) == 0)
+      return sock;
+  }
+  if (sock >= 0)
+    close(sock);
+  return -1;
+}
+
+static ssize_t receiveRaw(int sock, uint8_t* buffer, size_t size) {
+  pollfd p = { sock, POLLIN, 0 };
+  return poll(&p, 1, TIMEOUT_MILLIS) > 0 ? recv(sock, buffer, size, 0) : -1;
+}
+
+static void sendRaw(uint16_t port, const uint8_t* data, size_t size) {
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  CHECK(sendto(sock, data, size, 0, (const sockaddr*)&address, sizeof(address)) == (ssize_t)size);
+  close(sock);
+}
+
+// Streams the frames of all subjects and checks what the receiver decodes.
+static void testLoopback(uint8_t mode) {
+  FrameReceiver receiver;
+  uint16_t port = listen(receiver);
+  CHECK(port != 0);
+
+  FrameStreamer streamer;
+  CHECK(streamer.open("127.0.0.1", port, mode));
+  streamer.setMaxLatency(10000000); // batch until full or flushed
+  for (int s = 0; s < N_SUBJECTS; s++)
+    CHECK(streamer.add(s, makeFrame(s)));
+  CHECK(streamer.flush());
+
+  unsigned long nDatagrams = (N_SUBJECTS + streamer.getFramesPerDatagram() - 1) / streamer.getFramesPerDatagram();
+  CHECK(nDatagrams > 1);
+  CHECK(streamer.getSentCount() == nDatagrams);
+
+  Received received = { 0, 0, mode == STREAM_BINARY };
+  while (received.count < N_SUBJECTS && receiver.receive(onFrame, &received, TIMEOUT_MILLIS) > 0) {}
+  CHECK(received.count == N_SUBJECTS);
+  CHECK(received.bad == 0);
+  CHECK(receiver.getReceivedCount() == nDatagrams);
+  CHECK(receiver.getLostCount() == 0);
+  CHECK(receiver.getInvalidCount() == 0);
+}
+
+// Checks the bytes of a binary and an OSC datagram.
+static void testByteOrder() {
+  uint8_t record[FrameDatagram::RECORD_SIZE];
+  FrameDatagram::putRecord(record, 0x0A0B, makeFrame(0));
+  static const uint8_t RECORD_START[] = { 0x0A, 0x0B, 0, 0, 0x01, 0x02, 0x03, 0x04, 0x00, 0x01, 0xE2, 0x40 };
+  CHECK(memcmp(record, RECORD_START, sizeof(RECORD_START)) == 0);
+  static const uint8_t BPM[] = { 0x42, 0x72, 0x00, 0x00 }; // 60.5f
+  CHECK(memcmp(record + 20, BPM, 4) == 0);
+
+  uint16_t port;
+  int sock = listenRaw(port);
+  CHECK(sock >= 0);
+  if (sock < 0)
+    return;
+  uint8_t buffer[FrameDatagram::DEFAULT_MAX_SIZE];
+
+  FrameStreamer streamer;
+  CHECK(streamer.open("127.0.0.1", port, STREAM_BINARY));
+  CHECK(streamer.add(0x0A0B, makeFrame(0)));
+  CHECK(streamer.add(0x0A0B, makeFrame(0))); // second datagram: sequence 1
+  CHECK(receiveRaw(sock, buffer, sizeof(buffer)) == FrameDatagram::HEADER_SIZE + FrameDatagram::RECORD_SIZE);
+  CHECK(receiveRaw(sock, buffer, sizeof(buffer)) == FrameDatagram::HEADER_SIZE + FrameDatagram::RECORD_SIZE);
+  static const uint8_t BINARY_HEADER[] = { 'B', 'D', 'F', 'S', FrameDatagram::VERSION, STREAM_BINARY, 0, 0, 0, 1, 0, 1 };
+  CHECK(memcmp(buffer, BINARY_HEADER, sizeof(BINARY_HEADER)) == 0);
+  CHECK(memcmp(buffer + FrameDatagram::HEADER_SIZE, record, sizeof(record)) == 0);
+
+  CHECK(streamer.open("127.0.0.1", port, STREAM_OSC));
+  CHECK(streamer.add(0x0A0B, makeFrame(0)));
+  ssize_t n = receiveRaw(sock, buffer, sizeof(buffer));
+  CHECK(n == FrameDatagram::OSC_BUNDLE_SIZE + FrameDatagram::OSC_SEQUENCE_SIZE + FrameDatagram::OSC_FRAME_SIZE);
+  CHECK(memcmp(buffer, "#bundle\0\0\0\0\0\0\0\0\1", 16) == 0);
+  const uint8_t* message = buffer + FrameDatagram::OSC_BUNDLE_SIZE + FrameDatagram::OSC_SEQUENCE_SIZE;
+  static const uint8_t MESSAGE_SIZE[] = { 0, 0, 0, FrameDatagram::OSC_FRAME_SIZE - 4 };
+  CHECK(memcmp(message, MESSAGE_SIZE, 4) == 0);
+  static const uint8_t ARGUMENTS_START[] = { 0, 0, 0x0A, 0x0B, 0x01, 0x02, 0x03, 0x04, 0x00, 0x01, 0xE2, 0x40 };
+  CHECK(memcmp(message + 44, ARGUMENTS_START, sizeof(ARGUMENTS_START)) == 0);
+  CHECK(memcmp(message + 64 + 4, BPM, 4) == 0);
+  close(sock);
+}
+
+// Counts datagrams missing from the sequence and invalid datagrams.
+static void testLostAndInvalid() {
+  FrameReceiver receiver;
+  uint16_t port = listen(receiver);
+  CHECK(port != 0);
+
+  uint8_t datagram[FrameDatagram::HEADER_SIZE + FrameDatagram::RECORD_SIZE];
+  memcpy(datagram, "BDFS", 4);
+  datagram[4] = FrameDatagram::VERSION;
+  datagram[5] = STREAM_BINARY;
+  FrameDatagram::putShort(datagram + 10, 1);
+  FrameDatagram::putRecord(datagram + FrameDatagram::HEADER_SIZE, 1, makeFrame(1));
+
+  Received received = { 0, 0, true };
+  static const uint32_t SEQUENCES[] = { 7, 8, 12 };
+  for (int i = 0; i < 3; i++) {
+    FrameDatagram::putInt(datagram + 6, SEQUENCES[i]);
+    sendRaw(port, datagram, sizeof(datagram));
+    CHECK(receiver.receive(onFrame, &received, TIMEOUT_MILLIS) == 1);
+  }
+  CHECK(received.count == 3 && received.bad == 0);
+  CHECK(receiver.getLostCount() == 3);
+
+  datagram[0] = 'X';
+  sendRaw(port, datagram, sizeof(datagram));
+  CHECK(receiver.receive(onFrame, &received, TIMEOUT_MILLIS) == -1);
+  CHECK(receiver.getInvalidCount() == 1);
+  CHECK(receiver.getReceivedCount() == 3);
+}
+
+int main() {
+  testLoopback(STREAM_BINARY);
+  testLoopback(STREAM_OSC);
+  testByteOrder();
+  testLostAndInvalid();
+
+  if (failures)
+    fprintf(stderr, "%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
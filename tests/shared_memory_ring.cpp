@@ -0,0 +1,126 @@
+/******************************************************
+ * This file is part of the BioData project
+ * (c) 2018 Erin Gee   http://www.eringee.net
+ *
+ * SharedMemoryRing: frames and events written by a writer are read back in
+ * order by readers, a reader that falls behind counts what it lost, and
+ * recreating the ring leaves attached readers on the old one.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "SharedMemoryRing.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while (0)
+
+static FeatureFrame makeFrame(uint32_t sequence) {
+  FeatureFrame frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.sequence = sequence;
+  frame.bpm = 60 + sequence;
+  return frame;
+}
+
+// Reads the next record as a frame; returns its sequence number or -1.
+static long readFrame(SharedMemoryRing& ring) {
+  uint8_t type;
+  uint8_t data[SharedMemoryRing::DEFAULT_PAYLOAD_SIZE];
+  int size = ring.read(type, data, sizeof(data));
+  if (size != (int)sizeof(FeatureFrame) || type != SHM_RECORD_FRAME)
+    return -1;
+  FeatureFrame frame;
+  memcpy(&frame, data, sizeof(frame));
+  return frame.bpm == 60 + frame.sequence ? (long)frame.sequence : -1;
+}
+
+int main() {
+  char name[64];
+  snprintf(name, sizeof(name), "/biodata_test_%ld", (long)getpid());
+
+  // Round trip.
+  SharedMemoryRing writer;
+  CHECK(writer.create(name, 8));
+  SharedMemoryRing reader;
+  CHECK(reader.open(name));
+
+  uint8_t type;
+  uint8_t data[SharedMemoryRing::DEFAULT_PAYLOAD_SIZE];
+  CHECK(reader.read(type, data, sizeof(data)) == -1);
+
+  for (uint32_t i = 0; i < 5; i++)
+    CHECK(writer.writeFrame(makeFrame(i)));
+  BioEvent event;
+  memset(&event, 0, sizeof(event));
+  event.value = 1.5f;
+  CHECK(writer.writeEvent(event));
+
+  for (long i = 0; i < 5; i++)
+    CHECK(readFrame(reader) == i);
+  BioEvent received;
+  CHECK(reader.read(type, &received, sizeof(received)) == (int)sizeof(BioEvent));
+  CHECK(type == SHM_RECORD_EVENT && received.value == 1.5f);
+  CHECK(reader.read(type, data, sizeof(data)) == -1);
+  CHECK(reader.getLost() == 0);
+  CHECK(writer.getWritten() == 6);
+
+  // Readers cannot write, records larger than a slot are refused.
+  CHECK(!reader.writeFrame(makeFrame(0)));
+  CHECK(!writer.write(SHM_RECORD_FRAME, data, SharedMemoryRing::DEFAULT_PAYLOAD_SIZE + 1));
+
+  // Overrun: a reader more than a ring behind skips to the oldest record.
+  for (uint32_t i = 6; i < 26; i++)
+    CHECK(writer.writeFrame(makeFrame(i)));
+  CHECK(readFrame(reader) == 18);
+  CHECK(reader.getLost() == 12);
+
+  // Recreating the ring leaves the attached reader on the old (intact) one.
+  SharedMemoryRing second;
+  CHECK(second.create(name, 4));
+  CHECK(second.writeFrame(makeFrame(100)));
+  for (long i = 19; i < 26; i++)
+    CHECK(readFrame(reader) == i);
+  CHECK(readFrame(reader) == -1);
+  CHECK(reader.getLost() == 12);
+  CHECK(reader.getWritten() == 26);
+  CHECK(second.getWritten() == 1);
+
+  SharedMemoryRing reopened;
+  CHECK(reopened.open(name));
+  CHECK(readFrame(reopened) == -1);
+  CHECK(second.writeFrame(makeFrame(101)));
+  CHECK(readFrame(reopened) == 101);
+
+  // A closed reader cannot read.
+  reader.close();
+  CHECK(reader.read(type, data, sizeof(data)) == -1);
+
+  CHECK(SharedMemoryRing::unlink(name));
+  CHECK(!reopened.open(name));
+
+  if (failures)
+    fprintf(stderr, "%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}